@@ -5,48 +5,94 @@
 #include <cstdlib>
 #include <filesystem>
 
-#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 namespace G13::Editor {
+	namespace {
+		// How long to wait for the daemon to answer a command
+		constexpr int REPLY_TIMEOUT_MS = 2000;
+		constexpr size_t MAX_REPLY_SIZE = 64 * 1024;
+	}
+
 	DaemonClient::DaemonClient() {
 		if (const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR")) {
-			pipe_path = std::string(runtime_dir) + "/g13/in/0";
+			socket_path = std::string(runtime_dir) + "/g13/control/0";
 		} else {
-			pipe_path = "/tmp/g13/in/0";
+			socket_path = "/tmp/g13/control/0";
 		}
 	}
 
 	bool DaemonClient::send_reload_profiles(std::string& error) const {
-		return send_command("reload_profile\n", error);
+		return send_command("reload_profile", error);
 	}
 
 	bool DaemonClient::send_reload_profile(const std::string& guid, std::string& error) const {
-		return send_command("reload_profile " + guid + "\n", error);
+		return send_command("reload_profile " + guid, error);
 	}
 
 	bool DaemonClient::send_activate_profile(const std::string& guid, std::string& error) const {
-		return send_command("profile " + guid + "\n", error);
+		return send_command("profile " + guid, error);
 	}
 
 	bool DaemonClient::send_command(const std::string& command, std::string& error) const {
-		if (!std::filesystem::exists(pipe_path)) {
-			error = "Daemon input pipe does not exist: " + pipe_path;
+		if (!std::filesystem::exists(socket_path)) {
+			error = "Daemon control socket does not exist: " + socket_path;
+			return false;
+		}
+
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		if (socket_path.size() >= sizeof(address.sun_path)) {
+			error = "Daemon control socket path is too long: " + socket_path;
 			return false;
 		}
+		std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
 
-		const int fd = open(pipe_path.c_str(), O_WRONLY | O_NONBLOCK);
+		const int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
 		if (fd == -1) {
-			error = "Failed to open daemon input pipe: " + pipe_path + " (" + std::strerror(errno) + ")";
+			error = std::string("Failed to create socket (") + std::strerror(errno) + ")";
+			return false;
+		}
+		if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+			error = "Failed to connect to daemon control socket: " + socket_path + " (" + std::strerror(errno) + ")";
+			close(fd);
 			return false;
 		}
 
-		const auto written = write(fd, command.c_str(), command.size());
+		// One packet per command, one packet per reply
+		if (send(fd, command.data(), command.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(command.size())) {
+			error = std::string("Failed to send daemon command (") + std::strerror(errno) + ")";
+			close(fd);
+			return false;
+		}
+
+		pollfd ready{fd, POLLIN, 0};
+		if (poll(&ready, 1, REPLY_TIMEOUT_MS) != 1) {
+			error = "Daemon did not answer";
+			close(fd);
+			return false;
+		}
+		std::string reply(MAX_REPLY_SIZE, '\0');
+		const ssize_t length = recv(fd, reply.data(), reply.size(), 0);
 		close(fd);
-		if (written < 0 || static_cast<size_t>(written) != command.size()) {
-			error = "Failed to write daemon command";
+		if (length <= 0) {
+			error = "Daemon closed the connection without answering";
 			return false;
 		}
-		return true;
+		reply.resize(length);
+
+		const auto status_end = reply.find('\n');
+		const std::string status = reply.substr(0, status_end);
+		if (status == "ok") {
+			return true;
+		}
+		error = status_end == std::string::npos ? "Daemon reported an error" : reply.substr(status_end + 1);
+		while (!error.empty() && error.back() == '\n') {
+			error.pop_back();
+		}
+		return false;
 	}
 }
@@ -5,24 +5,24 @@
 
 namespace G13::Editor {
 	/**
-	 * Sends profile-control commands to the running g13 daemon FIFO.
+	 * Sends profile-control commands to the running g13 daemon's control socket and waits for its reply.
 	 */
 	class DaemonClient {
 	public:
 		/**
-		 * Path to the daemon input pipe used for editor commands.
+		 * Path to the daemon control socket used for editor commands.
 		 */
-		std::string pipe_path;
+		std::string socket_path;
 
 		/**
-		 * Creates a client using the default daemon pipe under XDG_RUNTIME_DIR.
+		 * Creates a client using the default daemon control socket under XDG_RUNTIME_DIR.
 		 */
 		DaemonClient();
 
 		/**
 		 * Requests a full profile directory reload from the daemon.
 		 * @param error receives a human-readable failure reason.
-		 * @return true when the command was written to the daemon FIFO.
+		 * @return true when the daemon reported success.
 		 */
 		bool send_reload_profiles(std::string& error) const;
 
@@ -30,7 +30,7 @@ namespace G13::Editor {
 		 * Requests a reload of one profile XML by GUID.
 		 * @param guid profile GUID to reload.
 		 * @param error receives a human-readable failure reason.
-		 * @return true when the command was written to the daemon FIFO.
+		 * @return true when the daemon reported success.
 		 */
 		bool send_reload_profile(const std::string& guid, std::string& error) const;
 
@@ -38,16 +38,16 @@ namespace G13::Editor {
 		 * Requests activation of one profile by GUID.
 		 * @param guid profile GUID to activate.
 		 * @param error receives a human-readable failure reason.
-		 * @return true when the command was written to the daemon FIFO.
+		 * @return true when the daemon reported success.
 		 */
 		bool send_activate_profile(const std::string& guid, std::string& error) const;
 
 	private:
 		/**
-		 * Writes a raw daemon command to the configured FIFO.
-		 * @param command daemon command text, including its trailing newline.
-		 * @param error receives a human-readable failure reason.
-		 * @return true when the complete command was written.
+		 * Sends one daemon command over the control socket and reads the reply.
+		 * @param command daemon command text.
+		 * @param error receives a human-readable failure reason, or the daemon's errors.
+		 * @return true when the daemon answered "ok".
 		 */
 		bool send_command(const std::string& command, std::string& error) const;
 	};
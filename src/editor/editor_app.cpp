@@ -220,8 +220,8 @@ namespace G13::Editor {
 	EditorApp::EditorApp() {
 		constexpr const char* test_profile = "{F954F39F-63B4-44B5-B947-137848537CEB}.xml";
 		const auto settings = load_editor_settings();
-		if (!settings.daemon_pipe.empty()) {
-			_daemon.pipe_path = settings.daemon_pipe;
+		if (!settings.daemon_socket.empty()) {
+			_daemon.socket_path = settings.daemon_socket;
 		}
 		_activate_after_reload = settings.activate_after_reload;
 		if (!settings.profile_dir.empty()) {
@@ -255,7 +255,7 @@ namespace G13::Editor {
 	EditorSettings EditorApp::settings() const {
 		EditorSettings settings;
 		settings.profile_dir = _profile_dir;
-		settings.daemon_pipe = _daemon.pipe_path;
+		settings.daemon_socket = _daemon.socket_path;
 		settings.activate_after_reload = _activate_after_reload;
 		settings.last_profile_guid = _document.model().guid;
 		return settings;
@@ -451,6 +451,14 @@ namespace G13::Editor {
 		}
 
 		auto& model = _document.model();
+		for (int shift_state = 1; shift_state <= SHIFT_STATE_COUNT; ++shift_state) {
+			if (shift_state > 1) {
+				ImGui::SameLine();
+			}
+			const std::string label = "M" + std::to_string(shift_state);
+			ImGui::RadioButton(label.c_str(), &_selected_shift_state, shift_state);
+		}
+		auto& assignments = model.assignments[_selected_shift_state - 1];
 		const ImVec2 available = ImGui::GetContentRegionAvail();
 		const float canvas_width = std::max(available.x, 420.0f);
 		const float canvas_height = std::min(std::max(available.y - 115.0f, 360.0f), 620.0f);
@@ -468,13 +476,13 @@ namespace G13::Editor {
 			const ImVec2 min(origin.x + region.min.x * canvas_size.x, origin.y + region.min.y * canvas_size.y);
 			const ImVec2 max(origin.x + region.max.x * canvas_size.x, origin.y + region.max.y * canvas_size.y);
 			const bool selected = _selected_context_id == region.context_id;
-			const auto assignment = model.assignments.find(region.context_id);
-			const Macro* macro = assignment == model.assignments.end() ? nullptr : _document.find_macro(assignment->second);
+			const auto assignment = assignments.find(region.context_id);
+			const Macro* macro = assignment == assignments.end() ? nullptr : _document.find_macro(assignment->second);
 			const std::string macro_keys = macro ? join_keys(macro->keys) : "";
 			const std::string macro_name = macro ? macro->name : "";
 			const ImU32 fill = !region.editable ? IM_COL32(72, 76, 82, 255)
 							 : selected ? IM_COL32(74, 123, 190, 255)
-							 : assignment == model.assignments.end() ? IM_COL32(56, 66, 79, 255)
+							 : assignment == assignments.end() ? IM_COL32(56, 66, 79, 255)
 							 : IM_COL32(57, 104, 85, 255);
 			draw_list->AddRectFilled(min, max, fill, 6.0f);
 			draw_list->AddRect(min, max, IM_COL32(180, 188, 198, 180), 6.0f);
@@ -510,20 +518,20 @@ namespace G13::Editor {
 			if (region.editable && ImGui::BeginDragDropTarget()) {
 				if (const ImGuiPayload* payload = ImGui::AcceptDragDropPayload("G13_MACRO_GUID")) {
 					const auto macro_guid = std::string(static_cast<const char*>(payload->Data), payload->DataSize - 1);
-					_document.set_assignment(region.context_id, macro_guid);
+					_document.set_assignment(_selected_shift_state, region.context_id, macro_guid);
 					_selected_context_id = region.context_id;
 				}
 				if (const ImGuiPayload* payload = ImGui::AcceptDragDropPayload("G13_ASSIGNMENT_CONTEXT_ID")) {
 					const auto source_context_id = std::string(static_cast<const char*>(payload->Data), payload->DataSize - 1);
 					if (source_context_id != region.context_id) {
 						std::string source_macro_guid;
-						if (const auto source_assignment = model.assignments.find(source_context_id);
-								source_assignment != model.assignments.end()) {
+						if (const auto source_assignment = assignments.find(source_context_id);
+								source_assignment != assignments.end()) {
 							source_macro_guid = source_assignment->second;
 						}
-						_document.set_assignment(region.context_id, source_macro_guid);
+						_document.set_assignment(_selected_shift_state, region.context_id, source_macro_guid);
 						if (!source_macro_guid.empty()) {
-							_document.set_assignment(source_context_id, "");
+							_document.set_assignment(_selected_shift_state, source_context_id, "");
 						}
 						_selected_context_id = region.context_id;
 					}
@@ -541,18 +549,18 @@ namespace G13::Editor {
 
 		ImGui::Text("Selected: %s", _selected_context_id.c_str());
 		std::string current_guid;
-		if (const auto found = model.assignments.find(_selected_context_id); found != model.assignments.end()) {
+		if (const auto found = assignments.find(_selected_context_id); found != assignments.end()) {
 			current_guid = found->second;
 		}
 		const std::string preview = current_guid.empty() ? "<unassigned>" : _document.macro_name(current_guid);
 		if (ImGui::BeginCombo("Macro", preview.c_str())) {
 			if (ImGui::Selectable("<unassigned>", current_guid.empty())) {
-				_document.set_assignment(_selected_context_id, "");
+				_document.set_assignment(_selected_shift_state, _selected_context_id, "");
 			}
 			for (const auto& macro : model.macros) {
 				const bool selected = current_guid == macro.guid;
 				if (ImGui::Selectable(macro.name.c_str(), selected)) {
-					_document.set_assignment(_selected_context_id, macro.guid);
+					_document.set_assignment(_selected_shift_state, _selected_context_id, macro.guid);
 				}
 			}
 			ImGui::EndCombo();
@@ -573,8 +581,8 @@ namespace G13::Editor {
 				scan_profile_dir();
 			}
 			ImGui::Separator();
-			ImGui::TextUnformatted("Daemon Pipe");
-			ImGui::InputText("##settings-daemon-pipe", &_daemon.pipe_path);
+			ImGui::TextUnformatted("Daemon Control Socket");
+			ImGui::InputText("##settings-daemon-socket", &_daemon.socket_path);
 			ImGui::Checkbox("Activate after reload", &_activate_after_reload);
 			ImGui::Separator();
 			if (ImGui::Button("Done")) {
@@ -702,7 +710,7 @@ namespace G13::Editor {
 					if (!_daemon.send_reload_profiles(error)) {
 						_status += "; reload-all failed: " + error;
 					} else {
-						_status += "; reload-all command sent";
+						_status += "; profiles reloaded";
 					}
 					_document = {};
 					_profile_path.clear();
@@ -929,13 +937,13 @@ namespace G13::Editor {
 			_status += "; reload failed: " + error;
 			return;
 		}
-		_status += "; reload command sent";
+		_status += "; reloaded";
 
 		if (_activate_after_reload) {
 			if (!_daemon.send_activate_profile(_document.model().guid, error)) {
 				_status += "; activation failed: " + error;
 			} else {
-				_status += "; activation command sent";
+				_status += "; activated";
 			}
 		}
 	}
@@ -943,7 +951,7 @@ namespace G13::Editor {
 	void EditorApp::save_settings() const {
 		auto merged = load_editor_settings();
 		merged.profile_dir = _profile_dir;
-		merged.daemon_pipe = _daemon.pipe_path;
+		merged.daemon_socket = _daemon.socket_path;
 		merged.activate_after_reload = _activate_after_reload;
 		merged.last_profile_guid = _document.model().guid;
 		save_editor_settings(merged);
@@ -60,6 +60,7 @@ namespace G13::Editor {
 		std::string _profile_search;
 		std::string _selected_macro_guid;
 		std::string _selected_context_id;
+		int _selected_shift_state = 1;
 		std::string _editing_macro_guid;
 		std::string _editing_macro_name;
 		std::string _editing_macro_keys;
@@ -91,8 +91,8 @@ namespace G13::Editor {
 			const auto value = trim(line.substr(separator + 1));
 			if (key == "profile_dir") {
 				settings.profile_dir = value;
-			} else if (key == "daemon_pipe") {
-				settings.daemon_pipe = value;
+			} else if (key == "daemon_socket") {
+				settings.daemon_socket = value;
 			} else if (key == "activate_after_reload") {
 				settings.activate_after_reload = parse_bool(value);
 			} else if (key == "last_profile_guid") {
@@ -124,7 +124,7 @@ namespace G13::Editor {
 		}
 
 		output << "profile_dir=" << settings.profile_dir << '\n';
-		output << "daemon_pipe=" << settings.daemon_pipe << '\n';
+		output << "daemon_socket=" << settings.daemon_socket << '\n';
 		output << "activate_after_reload=" << (settings.activate_after_reload ? "true" : "false") << '\n';
 		output << "last_profile_guid=" << settings.last_profile_guid << '\n';
 		output << "window_x=" << settings.window_x << '\n';
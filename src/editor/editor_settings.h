@@ -15,9 +15,9 @@ namespace G13::Editor {
 		std::string profile_dir;
 
 		/**
-		 * Daemon input FIFO path used for reload and activation commands.
+		 * Daemon control socket path used for reload and activation commands.
 		 */
-		std::string daemon_pipe;
+		std::string daemon_socket;
 
 		/**
 		 * Last profile GUID opened by the editor.
@@ -182,11 +182,15 @@ namespace G13::Editor {
 		return {};
 	}
 
-	void ProfileDocument::set_assignment(const std::string& context_id, const std::string& macro_guid) {
+	void ProfileDocument::set_assignment(int shift_state, const std::string& context_id, const std::string& macro_guid) {
+		if (shift_state < 1 || shift_state > SHIFT_STATE_COUNT) {
+			return;
+		}
+		auto& assignments = _model.assignments[shift_state - 1];
 		if (macro_guid.empty()) {
-			_model.assignments.erase(context_id);
+			assignments.erase(context_id);
 		} else {
-			_model.assignments[context_id] = macro_guid;
+			assignments[context_id] = macro_guid;
 		}
 		_model.dirty = true;
 	}
@@ -204,12 +208,10 @@ namespace G13::Editor {
 		std::erase_if(_model.macros, [&](const Macro& macro) {
 			return macro.guid == guid;
 		});
-		for (auto it = _model.assignments.begin(); it != _model.assignments.end();) {
-			if (it->second == guid) {
-				it = _model.assignments.erase(it);
-			} else {
-				++it;
-			}
+		for (auto& assignments : _model.assignments) {
+			std::erase_if(assignments, [&](const auto& assignment) {
+				return assignment.second == guid;
+			});
 		}
 		_model.dirty = true;
 	}
@@ -264,7 +266,12 @@ namespace G13::Editor {
 				if (std::string(assignment.attribute("backup").value()) != "false") {
 					continue;
 				}
-				_model.assignments[assignment.attribute("contextid").value()] = assignment.attribute("macroguid").value();
+				const int shift_state = assignment.attribute("shiftstate").as_int(1);
+				if (shift_state < 1 || shift_state > SHIFT_STATE_COUNT) {
+					continue;
+				}
+				_model.assignments[shift_state - 1][assignment.attribute("contextid").value()] =
+						assignment.attribute("macroguid").value();
 			}
 		}
 	}
@@ -341,32 +348,40 @@ namespace G13::Editor {
 		}
 
 		auto assignments = assignments_node();
-		std::set<std::string> seen_assignments;
+		std::set<std::pair<int, std::string>> seen_assignments;
 		for (auto assignment = assignments.child("assignment"); assignment;) {
 			const auto next = assignment.next_sibling("assignment");
 			if (std::string(assignment.attribute("backup").value()) == "false") {
+				const int shift_state = assignment.attribute("shiftstate").as_int(1);
 				const std::string context_id = assignment.attribute("contextid").value();
-				const auto desired = _model.assignments.find(context_id);
-				if (desired == _model.assignments.end()) {
+				if (shift_state < 1 || shift_state > SHIFT_STATE_COUNT) {
+					assignment = next;
+					continue;
+				}
+				const auto& desired_assignments = _model.assignments[shift_state - 1];
+				const auto desired = desired_assignments.find(context_id);
+				if (desired == desired_assignments.end()) {
 					assignments.remove_child(assignment);
 				} else {
 					assignment.attribute("macroguid").set_value(desired->second.c_str());
-					seen_assignments.insert(context_id);
+					seen_assignments.emplace(shift_state, context_id);
 				}
 			}
 			assignment = next;
 		}
 
-		for (const auto& [context_id, macro_guid] : _model.assignments) {
-			if (seen_assignments.contains(context_id)) {
-				continue;
+		for (int shift_state = 1; shift_state <= SHIFT_STATE_COUNT; ++shift_state) {
+			for (const auto& [context_id, macro_guid] : _model.assignments[shift_state - 1]) {
+				if (seen_assignments.contains({shift_state, context_id})) {
+					continue;
+				}
+				auto assignment = assignments.append_child("assignment");
+				assignment.append_attribute("original").set_value("false");
+				assignment.append_attribute("backup").set_value("false");
+				assignment.append_attribute("shiftstate").set_value(std::to_string(shift_state).c_str());
+				assignment.append_attribute("contextid").set_value(context_id.c_str());
+				assignment.append_attribute("macroguid").set_value(macro_guid.c_str());
 			}
-			auto assignment = assignments.append_child("assignment");
-			assignment.append_attribute("original").set_value("false");
-			assignment.append_attribute("backup").set_value("false");
-			assignment.append_attribute("shiftstate").set_value("1");
-			assignment.append_attribute("contextid").set_value(context_id.c_str());
-			assignment.append_attribute("macroguid").set_value(macro_guid.c_str());
 		}
 
 		if (!_model.backlight_color.empty()) {
@@ -82,10 +82,11 @@ namespace G13::Editor {
 
 		/**
 		 * Assigns a macro to a context id, or clears the assignment when macro_guid is empty.
+		 * @param shift_state M-key shift state to update, 1 to SHIFT_STATE_COUNT.
 		 * @param context_id G13 context id to update.
 		 * @param macro_guid macro GUID to assign, or empty to clear.
 		 */
-		void set_assignment(const std::string& context_id, const std::string& macro_guid);
+		void set_assignment(int shift_state, const std::string& context_id, const std::string& macro_guid);
 
 		/**
 		 * Adds a new editable macro with a generated GUID.
@@ -1,11 +1,22 @@
 #ifndef G13_EDITOR_PROFILE_MODEL_H
 #define G13_EDITOR_PROFILE_MODEL_H
 
+#include <array>
 #include <map>
 #include <string>
 #include <vector>
 
 namespace G13::Editor {
+	/**
+	 * Number of M-key shift states (M1, M2, M3) a profile can assign macros in.
+	 */
+	constexpr int SHIFT_STATE_COUNT = 3;
+
+	/**
+	 * Mapping from G13 context id to macro GUID.
+	 */
+	typedef std::map<std::string, std::string> AssignmentMap;
+
 	/**
 	 * Editable macro parsed from or written to a Logitech profile XML.
 	 */
@@ -66,9 +77,9 @@ namespace G13::Editor {
 		std::vector<Macro> macros;
 
 		/**
-		 * Mapping from G13 context id to macro GUID for active assignments.
+		 * Active assignments per shift state, index 0 holds the M1 (shiftstate="1") assignments.
 		 */
-		std::map<std::string, std::string> assignments;
+		std::array<AssignmentMap, SHIFT_STATE_COUNT> assignments;
 
 		/**
 		 * Hex RGB backlight color string when present in the source profile.
@@ -20,7 +20,7 @@ namespace G13 {
 		}
 	}
 
-	void G13_CurrentProfileApp::display(G13_Device& device) {
+	G13_DisplayApp::Deadline G13_CurrentProfileApp::display(G13_Device& device) {
 		// Clear screen first
 		device.lcd().image_clear();
 
@@ -28,6 +28,12 @@ namespace G13 {
 		device.lcd().write_pos(0, 0);
 		std::string profile_name = device.current_profile().name();
 		unsigned int profile_length = profile_name.length();
+
+		// The clock changes on the next full second
+		const auto now = std::chrono::system_clock::now();
+		const auto next_second = std::chrono::ceil<std::chrono::seconds>(now + std::chrono::milliseconds(1)) - now;
+		Deadline deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(next_second);
+
 		if (profile_length > 32) {
 			// Output 32 chars from a start point
 			device.lcd().write_string(profile_name.substr(name_start, 32).c_str(), false);
@@ -46,6 +52,9 @@ namespace G13 {
 				name_start += direction;
 				last_update = std::chrono::high_resolution_clock::now();
 			}
+
+			// Scroll the name again once it has been shown for 500ms
+			deadline = std::min(deadline, std::chrono::steady_clock::now() + std::chrono::milliseconds(501));
 		} else {
 			device.lcd().write_string(profile_name.c_str(), false);
 		}
@@ -65,6 +74,8 @@ namespace G13 {
 
 		// Send image to screen
 		device.lcd().image_send();
+
+		return deadline;
 	}
 
 	void G13_ProfileSwitcherApp::init(G13_Device& device) {
@@ -125,7 +136,7 @@ namespace G13 {
 		}
 	}
 
-	void G13_ProfileSwitcherApp::display(G13_Device& device) {
+	G13_DisplayApp::Deadline G13_ProfileSwitcherApp::display(G13_Device& device) {
 		// Clear screen first
 		device.lcd().image_clear();
 
@@ -244,9 +255,12 @@ namespace G13 {
 
 		// Reset text mode
 		device.lcd().text_mode = text_mode;
+
+		// Only changes through the LIGHT keys, which request a redraw
+		return NO_DEADLINE;
 	}
 
-	void G13_TesterApp::display(G13_Device& device) {
+	G13_DisplayApp::Deadline G13_TesterApp::display(G13_Device& device) {
 		// Clear screen first
 		device.lcd().image_clear();
 
@@ -261,5 +275,7 @@ namespace G13 {
 		device.lcd().write_string("abcdefghijklmnopqrstuvwxyzabcdef", false);
 		device.lcd().write_pos(4, 0);
 		device.lcd().write_string("01234567890123456789012345678901");
+
+		return NO_DEADLINE;
 	}
 }
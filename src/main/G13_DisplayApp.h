@@ -6,6 +6,7 @@
 #define G13_DISPLAYAPP_H
 
 #include <chrono>
+#include <memory>
 #include <utility>
 
 namespace G13 {
@@ -18,14 +19,29 @@ namespace G13 {
 	 */
 	class G13_DisplayApp {
 		public:
+			typedef std::chrono::steady_clock::time_point Deadline;
+
+			/**
+			 * @brief Deadline returned by apps that only need to redraw when something changes
+			 */
+			static constexpr Deadline NO_DEADLINE = Deadline::max();
+
 			explicit G13_DisplayApp(std::shared_ptr<G13_Log> logger, std::shared_ptr<G13_KeyMap> keymap) : _logger(std::move(logger)), _keymap(std::move(keymap)){}
 			virtual ~G13_DisplayApp() = default;
 
 			/**
-			 * @brief Renders the next frame on the display
+			 * @brief Renders the next frame on the display. Apps are only redrawn when their deadline passes or
+			 * after G13_Device::request_redraw, e.g. on a profile switch or a key action of the app.
 			 * @param device the device to send display updates to
+			 * @return when the app next needs to redraw on its own, or NO_DEADLINE
+			 */
+			virtual Deadline display(G13_Device& device) = 0;
+
+			/**
+			 * @brief Tells whether the app shows the stick position and must be redrawn whenever the stick moves.
+			 * @return true to redraw on stick movement
 			 */
-			virtual void display(G13_Device& device) = 0;
+			virtual bool redraw_on_stick_move() const { return false; }
 
 			/**
 			 * @brief Initializes the app allowing for setup such as actions for LIGHT keys. By default, all keys will do nothing when pressed, so this must be overridden to assign an action.
@@ -46,7 +62,8 @@ namespace G13 {
 			explicit G13_CurrentProfileApp(std::shared_ptr<G13_Log> logger, std::shared_ptr<G13_KeyMap> keymap) : G13_DisplayApp(std::move(logger), std::move(keymap)){}
 			~G13_CurrentProfileApp() override = default;
 
-			void display(G13_Device& device) override;
+			Deadline display(G13_Device& device) override;
+			bool redraw_on_stick_move() const override { return true; }
 		private:
 			unsigned int name_start = 0;
 			int direction = 1;
@@ -61,7 +78,7 @@ namespace G13 {
 			explicit G13_ProfileSwitcherApp(std::shared_ptr<G13_Log> logger, std::shared_ptr<G13_KeyMap> keymap) : G13_DisplayApp(std::move(logger), std::move(keymap)) {}
 			~G13_ProfileSwitcherApp() override = default;
 
-			void display(G13_Device& device) override;
+			Deadline display(G13_Device& device) override;
 			void init(G13_Device& device) override;
 		private:
 			unsigned int profile_display_start = 0;
@@ -76,7 +93,7 @@ namespace G13 {
 			explicit G13_TesterApp(std::shared_ptr<G13_Log> logger, std::shared_ptr<G13_KeyMap> keymap) : G13_DisplayApp(std::move(logger), std::move(keymap)){}
 			~G13_TesterApp() override = default;
 
-			void display(G13_Device& device) override;
+			Deadline display(G13_Device& device) override;
 	};
 }
 
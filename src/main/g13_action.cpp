@@ -28,11 +28,7 @@ namespace G13 {
 	void G13_Action_Keys::act(const bool is_down, G13_Device& device) {
 		for (int _key : _keys) {
 			device.send_event(EV_KEY, _key, is_down);
-			if (is_down) {
-				_logger->trace("sending KEY DOWN " + std::to_string(_key));
-			} else {
-				_logger->trace("sending KEY UP " + std::to_string(_key));
-			}
+			G13_LOG_TRACE(_logger, (is_down ? "sending KEY DOWN " : "sending KEY UP ") + std::to_string(_key));
 		}
 	}
 
@@ -45,6 +41,87 @@ namespace G13 {
 		}
 	}
 
+	G13_Action_Turbo::G13_Action_Turbo(std::shared_ptr<G13_Log> logger, std::shared_ptr<G13_KeyMap> keymap, const std::string& turbo) :
+			G13_Action(std::move(logger), std::move(keymap)) {
+		const auto colon = turbo.find(':');
+		if (colon == std::string::npos || sscanf(turbo.c_str(), "%i", &_rate) != 1 || _rate <= 0 || _rate > G13_TURBO_MAX_RATE) {
+			throw G13_CommandException("turbo needs a rate of 1 to " + std::to_string(G13_TURBO_MAX_RATE) + " : " + turbo);
+		}
+
+		std::stringstream buffer(turbo.substr(colon + 1));
+		std::string key;
+		while (getline(buffer, key, '+')) {
+			auto kval = _keymap->find_input_key_value(key);
+			if (kval == BAD_KEY_VALUE) {
+				throw G13_CommandException("create action unknown key : " + key);
+			}
+			_keys.push_back(kval);
+		}
+		if (_keys.empty()) {
+			throw G13_CommandException("turbo without keys : " + turbo);
+		}
+	}
+
+	G13_Action_Turbo::~G13_Action_Turbo() {
+		// Rebinding a held key drops the action, its timer must not outlive it
+		if (_device) {
+			_device->cancel_timer(_timer);
+			if (_keys_down) {
+				send_keys(*_device, false);
+			}
+		}
+	}
+
+	void G13_Action_Turbo::act(const bool is_down, G13_Device& device) {
+		if (is_down) {
+			if (_held++ == 0) {
+				// Press right away, then toggle every half period
+				_device = &device;
+				send_keys(device, true);
+				_start = G13_TimerWheel::Clock::now();
+				_toggles = 0;
+				schedule_toggle();
+			}
+		} else if (_held > 0 && --_held == 0) {
+			device.cancel_timer(_timer);
+			_timer = G13_TimerWheel::NO_TIMER;
+			if (_keys_down) {
+				send_keys(device, false);
+			}
+			_device = nullptr;
+		}
+	}
+
+	void G13_Action_Turbo::tick() {
+		send_keys(*_device, !_keys_down);
+		schedule_toggle();
+	}
+
+	void G13_Action_Turbo::schedule_toggle() {
+		// Counted from the press, so rounding to whole ticks does not add up
+		const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(G13_TimerWheel::Clock::now() - _start);
+		// A late wakeup skips the toggles it missed instead of bunching them up
+		_toggles = std::max(_toggles + 1, elapsed.count() * _rate / 500'000'000 + 1);
+		_timer = _device->schedule_timer_at(_start + std::chrono::nanoseconds(_toggles * 500'000'000 / _rate),
+											[this] { tick(); });
+	}
+
+	void G13_Action_Turbo::send_keys(G13_Device& device, bool is_down) {
+		for (int _key : _keys) {
+			device.send_event(EV_KEY, _key, is_down);
+		}
+		_keys_down = is_down;
+	}
+
+	void G13_Action_Turbo::dump(std::ostream& out) const {
+		out << " TURBO " << _rate << "/s: ";
+
+		for (size_t i = 0; i < _keys.size(); i++) {
+			if (i) out << " + ";
+			out << _keymap->find_input_key_name(_keys[i]);
+		}
+	}
+
 	G13_Action_PipeOut::G13_Action_PipeOut(std::shared_ptr<G13_Log> logger, std::shared_ptr<G13_KeyMap> keymap, std::string out) :
 			G13_Action(std::move(logger), std::move(keymap)), _out(out + "\n") {}
 
@@ -91,6 +168,8 @@ namespace G13 {
 	void G13_Action_Dynamic::act(const bool is_down, G13_Device& device) {
 		if (is_down) {
 			_action();
+			// Dynamic actions drive the display apps, show their effect right away
+			device.request_redraw();
 		}
 	}
 
@@ -11,10 +11,14 @@
 
 #include "container.h"
 #include "g13_key_map.h"
+#include "g13_timer_wheel.h"
 
 namespace G13 {
 	class G13_Device;
 
+	// fastest turbo rate, the keys toggle every millisecond
+	const int G13_TURBO_MAX_RATE = 500;
+
 	/*!
 	 * holds potential actions which can be bound to G13 activity
 	 */
@@ -27,6 +31,12 @@ namespace G13 {
 		virtual void act(bool is_down, G13_Device& device) = 0;
 		virtual void dump(std::ostream&) const = 0;
 
+		/*!
+		 * realtime actions only write to the uinput device, so they may run on a
+		 * device's input thread; all others are deferred to the worker thread
+		 */
+		virtual bool realtime() const { return false; }
+
 	protected:
 		std::shared_ptr<G13_Log> _logger;
 		std::shared_ptr<G13_KeyMap> _keymap;
@@ -41,8 +51,48 @@ namespace G13 {
 
 		void act(bool is_down, G13_Device& device) override;
 		virtual void dump(std::ostream&) const;
+		bool realtime() const override { return true; }
+
+		std::vector<LINUX_KEY_VALUE> _keys;
+	};
+
+	/*!
+	 * action to tap one or more keys at a fixed rate while the key is held
+	 *
+	 * Keys are pressed and released on alternate toggles from one-shot timers on the device
+	 * timer wheel, so their events are written together with the rest of the device output.
+	 * Toggle N is due at N half periods after the press, so rates that do not divide the
+	 * millisecond ticks still come out right on average.
+	 */
+	class G13_Action_Turbo : public G13_Action {
+	public:
+		/*!
+		 * @param turbo rate in taps per second, a colon and the keys, e.g. "20:KEY_A+KEY_B"
+		 * @throws G13_CommandException for bad rates and unknown keys
+		 */
+		G13_Action_Turbo(std::shared_ptr<G13_Log> logger, std::shared_ptr<G13_KeyMap> keymap, const std::string& turbo);
+		~G13_Action_Turbo() override;
+
+		void act(bool is_down, G13_Device& device) override;
+		void dump(std::ostream&) const override;
+		bool realtime() const override { return true; }
+
+	private:
+		void tick();
+		void schedule_toggle();
+		void send_keys(G13_Device& device, bool is_down);
 
 		std::vector<LINUX_KEY_VALUE> _keys;
+		int _rate;
+		// number of keys holding this action, the first press starts and the last release stops it
+		int _held = 0;
+		bool _keys_down = false;
+		G13_TimerWheel::TimerId _timer = G13_TimerWheel::NO_TIMER;
+		// time of the first press and number of toggles since
+		G13_TimerWheel::Clock::time_point _start;
+		int64_t _toggles = 0;
+		// device running the timer, set while the action is held
+		G13_Device* _device = nullptr;
 	};
 
 	/*!
@@ -0,0 +1,193 @@
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "g13_control_server.h"
+#include "g13_device.h"
+#include "g13_event_loop.h"
+#include "g13_log.h"
+
+namespace G13 {
+	G13_ControlServer::~G13_ControlServer() {
+		while (!_clients.empty()) {
+			close_client(_clients.begin()->first);
+		}
+		if (_listen_fd != -1) {
+			_loop->remove_fd(_listen_fd);
+			close(_listen_fd);
+			unlink(_path.c_str());
+		}
+	}
+
+	bool G13_ControlServer::start(const std::string& path, G13_EventLoop& loop) {
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path)) {
+			_logger->error("control socket path too long: " + path);
+			return false;
+		}
+		memcpy(address.sun_path, path.c_str(), path.size());
+
+		if (const auto directory = std::filesystem::path(path).parent_path(); !directory.empty()) {
+			std::error_code error;
+			std::filesystem::create_directories(directory, error);
+			if (error) {
+				_logger->error("failed creating control socket directory " + directory.string() + ": " + error.message());
+				return false;
+			}
+		}
+
+		_listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (_listen_fd == -1) {
+			_logger->error(std::string("failed creating control socket: ") + strerror(errno));
+			return false;
+		}
+
+		// A socket file left behind by a previous run would make bind fail
+		unlink(path.c_str());
+		if (bind(_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(_listen_fd, 8) != 0) {
+			_logger->error("failed listening on control socket " + path + ": " + strerror(errno));
+			close(_listen_fd);
+			_listen_fd = -1;
+			return false;
+		}
+		// Same access as the command FIFOs
+		chmod(path.c_str(), 0666);
+
+		_path = path;
+		_loop = &loop;
+		_loop->add_fd(_listen_fd, EPOLLIN, [this](uint32_t) {
+			accept_clients();
+		});
+		_logger->info("Listening for commands on " + path);
+		return true;
+	}
+
+	void G13_ControlServer::accept_clients() {
+		while (true) {
+			const int fd = accept4(_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (fd == -1) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+					_logger->warning(std::string("failed accepting control client: ") + strerror(errno));
+				}
+				return;
+			}
+			if (_clients.size() >= G13_CONTROL_MAX_CLIENTS) {
+				_logger->warning("too many control clients, refusing one");
+				close(fd);
+				continue;
+			}
+
+			_clients.emplace(fd, Client{});
+			_loop->add_fd(fd, EPOLLIN, [this, fd](uint32_t events) {
+				serve_client(fd, events);
+			});
+		}
+	}
+
+	void G13_ControlServer::serve_client(int fd, uint32_t events) {
+		const auto found = _clients.find(fd);
+		if (found == _clients.end()) {
+			return;
+		}
+		Client& client = found->second;
+
+		if (client.waiting) {
+			if (events & (EPOLLHUP | EPOLLERR)) {
+				return close_client(fd);
+			}
+			// Requests are read again once the reply is out
+			if (!(events & EPOLLOUT) || !flush_reply(fd, client)) {
+				return;
+			}
+		}
+
+		while (true) {
+			// With MSG_TRUNC the full length of a packet is returned even if it did not fit
+			const ssize_t length = recv(fd, _request.data(), _request.size(), MSG_DONTWAIT | MSG_TRUNC);
+			if (length == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+				break;
+			}
+			if (length <= 0) {
+				// Zero is an orderly shutdown of the client
+				return close_client(fd);
+			}
+
+			if (static_cast<size_t>(length) > _request.size()) {
+				client.reply = "error\nrequest larger than " + std::to_string(_request.size()) + " bytes\n";
+				client.fds.clear();
+			} else {
+				std::string line(_request.data(), length);
+				line.erase(line.find_last_not_of(" \t\r\n") + 1);
+				G13_Device::CommandReply result = _device.execute(line);
+				client.reply = result.ok ? "ok\n" + result.output : "error\n" + result.output + "\n";
+				client.fds = std::move(result.fds);
+			}
+
+			if (!flush_reply(fd, client)) {
+				return;
+			}
+		}
+
+		if (events & (EPOLLHUP | EPOLLERR)) {
+			close_client(fd);
+		}
+	}
+
+	bool G13_ControlServer::flush_reply(int fd, Client& client) {
+		if (send_reply(fd, client.reply, client.fds) != static_cast<ssize_t>(client.reply.size())) {
+			// A client sending requests faster than it reads the replies fills its socket queue
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				if (!client.waiting) {
+					client.waiting = true;
+					_loop->modify_fd(fd, EPOLLOUT);
+				}
+				return false;
+			}
+			_logger->warning(std::string("dropping control client, reply failed: ") + strerror(errno));
+			close_client(fd);
+			return false;
+		}
+
+		client.reply.clear();
+		client.fds.clear();
+		if (client.waiting) {
+			client.waiting = false;
+			_loop->modify_fd(fd, EPOLLIN);
+		}
+		return true;
+	}
+
+	ssize_t G13_ControlServer::send_reply(int fd, const std::string& reply, const std::vector<int>& fds) {
+		iovec data{const_cast<char*>(reply.data()), reply.size()};
+		msghdr message{};
+		message.msg_iov = &data;
+		message.msg_iovlen = 1;
+
+		// The client receives its own copies of the descriptors
+		std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+		if (!fds.empty()) {
+			message.msg_control = control.data();
+			message.msg_controllen = control.size();
+			cmsghdr* header = CMSG_FIRSTHDR(&message);
+			header->cmsg_level = SOL_SOCKET;
+			header->cmsg_type = SCM_RIGHTS;
+			header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+			memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+		}
+		return sendmsg(fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+
+	void G13_ControlServer::close_client(int fd) {
+		_loop->remove_fd(fd);
+		close(fd);
+		_clients.erase(fd);
+	}
+}
@@ -0,0 +1,101 @@
+#ifndef G13_G13_CONTROL_SERVER_H
+#define G13_G13_CONTROL_SERVER_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace G13 {
+	class G13_Device;
+	class G13_EventLoop;
+	class G13_Log;
+
+	// Largest command a client may send in one request
+	const size_t G13_CONTROL_REQUEST_SIZE = 64 * 1024;
+	const size_t G13_CONTROL_MAX_CLIENTS = 32;
+
+	/**
+	 * @brief Serves a device's commands on a SOCK_SEQPACKET Unix socket.
+	 *
+	 * Every packet a client sends is one command, every command is answered with one packet:
+	 * "ok" or "error" on the first line, followed by what the command printed or by its
+	 * errors. Descriptors a command hands out, like the shared framebuffer, come along as
+	 * SCM_RIGHTS. Clients are independent of each other and of the FIFOs. The listening socket
+	 * and all clients are served by the event loop passed to start().
+	 */
+	class G13_ControlServer {
+	public:
+		G13_ControlServer(std::shared_ptr<G13_Log> logger, G13_Device& device) :
+				_logger(std::move(logger)), _device(device) {}
+
+		/**
+		 * @brief Stops watching the sockets, closes them and removes the socket file.
+		 */
+		~G13_ControlServer();
+
+		G13_ControlServer(const G13_ControlServer&) = delete;
+		G13_ControlServer& operator=(const G13_ControlServer&) = delete;
+
+		/**
+		 * @brief Creates the socket, replacing a stale socket file, and starts accepting clients.
+		 * @param path socket path, missing directories are created.
+		 * @param loop loop serving the socket, must outlive the server.
+		 * @return true when the socket is listening.
+		 */
+		bool start(const std::string& path, G13_EventLoop& loop);
+
+		const std::string& path() const { return _path; }
+
+	private:
+		void accept_clients();
+
+		/**
+		 * @brief A connected client. A reply the socket could not take yet is kept until it is
+		 * writable again, no further requests are read meanwhile.
+		 */
+		struct Client {
+			std::string reply;
+			std::vector<int> fds;
+			bool waiting = false;
+		};
+
+		/**
+		 * @brief Answers the pending requests of a client, or drops it when it hung up.
+		 * @param fd client socket.
+		 * @param events ready events reported by the loop.
+		 */
+		void serve_client(int fd, uint32_t events);
+
+		/**
+		 * @brief Sends the client's reply, or waits for the socket to become writable when it is full.
+		 * @param fd client socket.
+		 * @param client client whose reply is sent.
+		 * @return true when the reply was sent; false when it waits, or when the client was dropped.
+		 */
+		bool flush_reply(int fd, Client& client);
+
+		/**
+		 * @brief Sends one reply packet, with descriptors attached when there are any.
+		 * @param fd client socket.
+		 * @param reply reply text.
+		 * @param fds descriptors passed to the client.
+		 * @return bytes sent, or -1 on failure.
+		 */
+		ssize_t send_reply(int fd, const std::string& reply, const std::vector<int>& fds);
+
+		void close_client(int fd);
+
+		std::shared_ptr<G13_Log> _logger;
+		G13_Device& _device;
+		G13_EventLoop* _loop = nullptr;
+		std::string _path;
+		int _listen_fd = -1;
+		std::map<int, Client> _clients;
+		std::vector<char> _request = std::vector<char>(G13_CONTROL_REQUEST_SIZE);
+	};
+}
+
+#endif //G13_G13_CONTROL_SERVER_H
@@ -3,6 +3,7 @@
 //
 
 #include <fcntl.h>
+#include <algorithm>
 #include <cerrno>
 #include <cstdlib>
 #include <cstring>
@@ -11,10 +12,13 @@
 #include <iostream>
 #include <libusb-1.0/libusb.h>
 #include <linux/uinput.h>
-#include <set>
+#include <span>
 #include <sstream>
 #include <string>
 #include <system_error>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <vector>
@@ -26,12 +30,18 @@
 #include "g13_action.h"
 #include "g13_device.h"
 #include "G13_DisplayApp.h"
+#include "g13_event_loop.h"
 #include "g13_fonts.h"
+#include "g13_key_bindings.h"
 #include "g13_keys.h"
 #include "g13_lcd.h"
 #include "g13_log.h"
+#include "g13_macro.h"
 #include "g13_manager.h"
+#include "g13_memory_backend.h"
 #include "g13_profile.h"
+#include "g13_report_log.h"
+#include "g13_shared_framebuffer.h"
 #include "g13_stick.h"
 #include "logo.h"
 #include "helper.h"
@@ -73,11 +83,11 @@ namespace G13 {
 		}
 	}
 
-	G13_Device::G13_Device(std::shared_ptr<G13_Log> logger, libusb_device_handle* handle, unsigned long _id, std::string profiles_dir = "") :
+	G13_Device::G13_Device(std::shared_ptr<G13_Log> logger, std::unique_ptr<G13_Backend> backend, unsigned long _id, std::string profiles_dir = "") :
 		_id_within_manager(_id),
-		handle(handle),
-		ctx(0),
-		_uinput_fid(-1),
+		_backend(std::move(backend)),
+		_input_pipe_fid(-1),
+		_output_pipe_fid(-1),
 		_logger(std::move(logger)),
 		_lcd(*this, *_logger),
 		_profiles_dir(std::move(profiles_dir)){
@@ -91,88 +101,27 @@ namespace G13 {
 		_current_profile = std::make_shared<G13_Profile>("default", "default");
 		_profiles["default"] = _current_profile;
 
-		for (bool& key : keys)
-			key = false;
-
 		lcd().image_clear();
 
 		_init_commands();
-
-		key_buffer = new unsigned char[G13_REPORT_SIZE*2];
-		transfer = nullptr;
 	}
 
 	G13_Device::~G13_Device() {
-		delete[] key_buffer;
-		libusb_free_transfer(transfer);
+		stop_input_thread();
 	}
 
 	G13_Device& G13_Device::init() {
 		_stick = std::make_shared<G13_Stick>(_logger);
+		_macros = std::make_shared<G13_MacroPlayer>(*this);
+		_key_bindings = std::make_shared<G13_KeyBindingState>(*this);
+		_layer_leds_action = std::make_shared<G13_Action_Dynamic>(_logger, Container::Instance().Resolve<G13_KeyMap>(), [this] {
+			set_mode_leds(1 << _layer);
+		});
 		_init_apps();
 
 		return *this;
 	}
 
-	int G13_Device::g13_create_uinput() {
-		struct uinput_user_dev uinp;
-		const char* dev_uinput_fname =
-				access("/dev/input/uinput", F_OK) == 0 ? "/dev/input/uinput" :
-				access("/dev/uinput", F_OK) == 0 ? "/dev/uinput" : 0;
-		if (!dev_uinput_fname) {
-			_logger->error("Could not find an uinput device");
-			return -1;
-		}
-		if (access(dev_uinput_fname, W_OK) != 0) {
-			_logger->error(std::to_string(*dev_uinput_fname) + " doesn't grant write permissions");
-			return -1;
-		}
-		int ufile = open(dev_uinput_fname, O_WRONLY | O_NDELAY);
-		if (ufile <= 0) {
-			_logger->error("Could not open uinput");
-			return -1;
-		}
-		memset(&uinp, 0, sizeof(uinp));
-		char name[] = "G13";
-		strncpy(uinp.name, name, sizeof(name));
-		uinp.id.version = 1;
-		uinp.id.bustype = BUS_USB;
-		uinp.id.product = G13_PRODUCT_ID;
-		uinp.id.vendor = G13_VENDOR_ID;
-		uinp.absmin[ABS_X] = 0;
-		uinp.absmin[ABS_Y] = 0;
-		uinp.absmax[ABS_X] = 0xff;
-		uinp.absmax[ABS_Y] = 0xff;
-		//  uinp.absfuzz[ABS_X] = 4;
-		//  uinp.absfuzz[ABS_Y] = 4;
-		//  uinp.absflat[ABS_X] = 0x80;
-		//  uinp.absflat[ABS_Y] = 0x80;
-
-		ioctl(ufile, UI_SET_EVBIT, EV_KEY);
-		ioctl(ufile, UI_SET_EVBIT, EV_ABS);
-		/*  ioctl(ufile, UI_SET_EVBIT, EV_REL);*/
-		ioctl(ufile, UI_SET_MSCBIT, MSC_SCAN);
-		ioctl(ufile, UI_SET_ABSBIT, ABS_X);
-		ioctl(ufile, UI_SET_ABSBIT, ABS_Y);
-		/*  ioctl(ufile, UI_SET_RELBIT, REL_X);
-		 ioctl(ufile, UI_SET_RELBIT, REL_Y);*/
-		for (int i = 0; i < 256; i++)
-			ioctl(ufile, UI_SET_KEYBIT, i);
-		ioctl(ufile, UI_SET_KEYBIT, BTN_THUMB);
-
-		int retcode = write(ufile, &uinp, sizeof(uinp));
-		if (retcode < 0) {
-			_logger->error("Could not write to uinput device (" + std::to_string(retcode) + ")");
-			return -1;
-		}
-		retcode = ioctl(ufile, UI_DEV_CREATE);
-		if (retcode) {
-			_logger->error("Error creating uinput device for G13");
-			return -1;
-		}
-		return ufile;
-	}
-
 	int G13_Device::g13_create_fifo(const char* fifo_name) {
 		// Get just the path
 		std::string path(fifo_name);
@@ -205,48 +154,12 @@ namespace G13 {
 		return fifo;
 	}
 
-	std::string G13_Device::describe_libusb_error_code(int code) {
-		switch (code) {
-			case LIBUSB_SUCCESS: return "SUCCESS";
-			case LIBUSB_ERROR_IO: return "ERROR_IO";
-			case LIBUSB_ERROR_INVALID_PARAM: return "ERROR_INVALID_PARAM";
-			case LIBUSB_ERROR_ACCESS: return "ERROR_ACCESS";
-			case LIBUSB_ERROR_NO_DEVICE: return "ERROR_NO_DEVICE";
-			case LIBUSB_ERROR_NOT_FOUND: return "ERROR_NOT_FOUND";
-			case LIBUSB_ERROR_BUSY: return "ERROR_BUSY";
-			case LIBUSB_ERROR_TIMEOUT: return "ERROR_TIMEOUT";
-			case LIBUSB_ERROR_OVERFLOW: return "ERROR_OVERFLOW";
-			case LIBUSB_ERROR_PIPE: return "ERROR_PIPE";
-			case LIBUSB_ERROR_INTERRUPTED: return "ERROR_INTERRUPTED";
-			case LIBUSB_ERROR_NO_MEM: return "ERROR_NO_MEM";
-			case LIBUSB_ERROR_NOT_SUPPORTED: return "ERROR_NOT_SUPPORTED";
-			case LIBUSB_ERROR_OTHER: return "ERROR_OTHER";
-			default: return "unknown error";
-		}
-	}
-
-	void G13_Device::init_lcd() {
-		int error = libusb_control_transfer(handle, 0, 9, 1, 0, 0, 0, 1000);
-		if (error) {
-			_logger->error("Error when initializing lcd endpoint");
-		}
-	}
-
 	void G13_Device::write_lcd(unsigned char* data, size_t size) {
-		init_lcd();
 		if (size != G13_LCD_BUFFER_SIZE) {
 			_logger->error("Invalid LCD data size " + std::to_string(size) + ", should be " + std::to_string(G13_LCD_BUFFER_SIZE));
 			return;
 		}
-		unsigned char buffer[G13_LCD_BUFFER_SIZE + 32];
-		memset(buffer, 0, G13_LCD_BUFFER_SIZE + 32);
-		buffer[0] = 0x03;
-		memcpy(buffer + 32, data, G13_LCD_BUFFER_SIZE);
-		int bytes_written;
-		int error = libusb_interrupt_transfer(handle, LIBUSB_ENDPOINT_OUT | G13_LCD_ENDPOINT, buffer,
-											  G13_LCD_BUFFER_SIZE + 32, &bytes_written, 1000);
-		if (error)
-			_logger->error("Error when transferring image: " + std::to_string(error) + ", " + std::to_string(bytes_written) + " bytes written");
+		_backend->lcd().write(data);
 	}
 
 	void G13_Device::write_lcd_file(const string& filename) {
@@ -265,53 +178,103 @@ namespace G13 {
 		pbuf->sgetn(buffer, size);
 
 		filestr.close();
-		write_lcd((unsigned char*) buffer, size);
+		lcd().image((unsigned char*) buffer, size);
 	}
 
 	void G13_Device::parse_joystick(unsigned char* buf) {
 		_stick->parse_joystick(*this, buf);
+
+		const uint16_t stick_report = buf[1] << 8 | buf[2];
+		if (stick_report != _last_stick_report) {
+			_last_stick_report = stick_report;
+			if (_redraw_on_stick.load(std::memory_order_relaxed)) {
+				request_redraw();
+			}
+		}
 	}
 
 	void G13_Device::send_event(int type, int code, int val) {
-		memset(&_event, 0, sizeof(_event));
-		gettimeofday(&_event.time, nullptr);
-		_event.type = type;
-		_event.code = code;
-		_event.value = val;
-		write(_uinput_fid, &_event, sizeof(_event));
+		if (_event_count == G13_EVENT_BATCH_SIZE) {
+			flush_events();
+		}
+
+		input_event& event = _events[_event_count++];
+		if (_batching_events) {
+			event.time = _batch_time;
+			_batch_has_events = true;
+		} else {
+			gettimeofday(&event.time, nullptr);
+		}
+		event.type = type;
+		event.code = code;
+		event.value = val;
+
+		// Outside of a report there is nothing to batch with
+		if (!_batching_events) {
+			flush_events();
+		}
+	}
+
+	void G13_Device::begin_events(const timeval& time) {
+		_batching_events = true;
+		_batch_time = time;
+	}
+
+	void G13_Device::sync_events() {
+		if (_batching_events && !_batch_has_events) {
+			return;
+		}
+		send_event(EV_SYN, SYN_REPORT, 0);
+		if (_batching_events) {
+			_batch_has_events = false;
+			_batch_synced = true;
+		}
+	}
+
+	bool G13_Device::end_events() {
+		// Reports and timers that changed nothing don't need a write at all
+		const bool had_events = _batch_has_events || _batch_synced;
+		if (_batch_has_events) {
+			send_event(EV_SYN, SYN_REPORT, 0);
+		}
+		_batching_events = false;
+		_batch_has_events = false;
+		_batch_synced = false;
+		flush_events();
+		return had_events;
+	}
+
+	void G13_Device::flush_events() {
+		if (_event_count == 0) {
+			return;
+		}
+		_backend->events().write(_events, _event_count);
+		_event_count = 0;
 	}
 
 	void G13_Device::write_output_pipe(const std::string& out) {
+		if (_command_output) {
+			*_command_output += out;
+			return;
+		}
 		write(_output_pipe_fid, out.c_str(), out.size());
 	}
 
 	void G13_Device::set_mode_leds(int leds) {
+		_backend->leds().set_mode_leds(leds);
+	}
 
-		unsigned char usb_data[] = {5, 0, 0, 0, 0};
-		usb_data[1] = leds;
-		int r = libusb_control_transfer(handle,
-										(uint8_t) LIBUSB_REQUEST_TYPE_CLASS | (uint8_t) LIBUSB_RECIPIENT_INTERFACE, 9, 0x305, 0,
-										usb_data, 5, 1000);
-		if (r != 5) {
-			_logger->error("Problem sending data");
+	void G13_Device::set_layer(int layer) {
+		if (layer == _layer || layer < 0 || layer >= G13_NUM_LAYERS) {
 			return;
 		}
+		_layer = layer;
+		G13_LOG_DEBUG(_logger, "layer switched to M" + std::to_string(layer + 1));
+		dispatch(_layer_leds_action, true);
 	}
 
 	void G13_Device::set_key_color(int red, int green, int blue) {
-		int error;
-		unsigned char usb_data[] = {5, 0, 0, 0, 0};
-		usb_data[1] = red;
-		usb_data[2] = green;
-		usb_data[3] = blue;
-
-		error = libusb_control_transfer(handle,
-										(uint8_t) LIBUSB_REQUEST_TYPE_CLASS | (uint8_t) LIBUSB_RECIPIENT_INTERFACE, 9, 0x307, 0,
-										usb_data, 5, 1000);
-		if (error != 5) {
-			_logger->error("Problem sending data");
-			return;
-		}
+		_backend->leds().set_key_color(red, green, blue);
 	}
 
 	std::string G13_Device::make_pipe_name(G13_Manager& manager, bool is_input) {
@@ -332,22 +295,33 @@ namespace G13 {
 		return std::format("{}-{}-{}", config_base, id_within_manager(), direction);
 	}
 
-	void G13_Device::register_context(libusb_context* _ctx, G13_Manager& manager) {
-		ctx = _ctx;
+	std::string G13_Device::make_socket_name(G13_Manager& manager) {
+		const std::string config_base = manager.string_config_value("control_socket");
+		if (config_base == "off") {
+			return {};
+		}
+		if (config_base.empty()) {
+			return std::format("{}/control/{}", default_pipe_root(), id_within_manager());
+		}
+		return std::format("{}-{}", config_base, id_within_manager());
+	}
 
-		int leds = 0;
+	void G13_Device::open_transports(G13_Manager& manager) {
+		int leds = 1 << _layer;
 		int red = 0;
 		int green = 0;
 		int blue = 255;
-		init_lcd();
+		// The LCD endpoint only needs to be initialized once per device
+		_backend->lcd().init();
 
 		set_mode_leds(leds);
 		set_key_color(red, green, blue);
 
-		write_lcd(g13_logo, sizeof(g13_logo));
+		lcd().image(g13_logo, sizeof(g13_logo));
 
-		_uinput_fid = g13_create_uinput();
+		_backend->events().open();
 
+		_raw_lcd_images = manager.string_config_value("raw_lcd_images", "off") == "on";
 		_input_pipe_name = make_pipe_name(manager, true);
 		_input_pipe_fid = g13_create_fifo(_input_pipe_name.c_str());
 		_output_pipe_name = make_pipe_name(manager, false);
@@ -362,77 +336,296 @@ namespace G13 {
 	}
 
 	void G13_Device::cleanup() {
+		stop_input_thread();
+		_backend->keys().stop();
+		if (_lost_fd != -1) {
+			close(_lost_fd);
+			_lost_fd = -1;
+		}
+		// Keys held at shutdown are released while the event sink is still open
+		for (auto& pressed : _pressed_actions) {
+			if (pressed) {
+				pressed->act(false, *this);
+				pressed.reset();
+			}
+		}
+		_backend->lcd().stop();
 		remove(_input_pipe_name.c_str());
 		remove(_output_pipe_name.c_str());
-		ioctl(_uinput_fid, UI_DEV_DESTROY);
-		close(_uinput_fid);
-		libusb_release_interface(handle, 0);
-		libusb_close(handle);
-	}
-
-	/**
-	 * Handles the libusb transfer completion event.
-	 *
-	 * @param transfer
-	 */
-	void transfer_cb(struct libusb_transfer* transfer) {
-		// Fetch the device from user_data
-		auto* device = static_cast<G13_Device*>(transfer->user_data);
-		switch(transfer->status) {
-			case LIBUSB_TRANSFER_COMPLETED: {
-				unsigned char* buffer = transfer->buffer;
-				device->parse_joystick(buffer);
-				device->current_profile().parse_keys(buffer, *device);
-				device->send_event(EV_SYN, SYN_REPORT, 0);
-				break;
+		_backend->events().close();
+		_backend->close();
+		_shared_framebuffer.reset();
+	}
+
+	bool G13_Device::open_shared_framebuffer() {
+		auto framebuffer = std::make_unique<G13_SharedFramebuffer>(_logger);
+		if (!framebuffer->open(std::format("g13-lcd-{}", _id_within_manager))) {
+			return false;
+		}
+		_shared_framebuffer = std::move(framebuffer);
+		return true;
+	}
+
+	int G13_Device::shared_framebuffer_fd() const {
+		return _shared_framebuffer ? _shared_framebuffer->doorbell_fd() : -1;
+	}
+
+	void G13_Device::show_shared_frame() {
+		uint64_t sequence;
+		// Pushed straight from the client's memory
+		if (unsigned char* frame = _shared_framebuffer->take_frame(sequence)) {
+			lcd().image(frame, G13_LCD_BUFFER_SIZE);
+			_shared_framebuffer->shown(sequence);
+		}
+	}
+
+	void G13_Device::process_report(unsigned char* buffer, const timeval& time, G13_LatencyClock::time_point received) {
+		const auto dispatching = G13_LatencyClock::now();
+		begin_events(time);
+		parse_joystick(buffer);
+		current_profile().parse_keys(buffer, *this);
+		const auto dispatched = G13_LatencyClock::now();
+		const bool wrote = end_events();
+		_latency.record(received, dispatching, dispatched, G13_LatencyClock::now(), wrote);
+	}
+
+	static_assert(G13_REPORT_LOG_REPORT_SIZE == G13_REPORT_SIZE);
+
+	bool G13_Device::record_reports(const std::string& filename) {
+		auto recorder = std::make_shared<G13_ReportRecorder>(_logger);
+		if (!recorder->open(filename)) {
+			return false;
+		}
+		_logger->info("Recording key reports to " + filename);
+		_recorder = recorder;
+		return true;
+	}
+
+	void G13_Device::handle_report(unsigned char* buffer, const timeval& time, G13_LatencyClock::time_point received) {
+		if (_recorder) {
+			_recorder->record(buffer, received);
+		}
+		process_report(buffer, time, received);
+	}
+
+	int G13_Device::read_keys(size_t transfer_count) {
+		auto handle = [this](unsigned char* buffer, const timeval& time, G13_LatencyClock::time_point received) {
+			handle_report(buffer, time, received);
+		};
+		if (_lost_fd == -1) {
+			_lost_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (_lost_fd == -1) {
+				_logger->error(std::string("Failed creating device lost eventfd: ") + std::strerror(errno));
+				return -1;
+			}
+		}
+		// Called from wherever USB events are handled, the worker learns about it through the eventfd
+		auto lost = [this] {
+			const uint64_t one = 1;
+			write(_lost_fd, &one, sizeof(one));
+		};
+		return _backend->keys().start(transfer_count, handle, lost) ? 0 : -1;
+	}
+
+	void G13_Device::dispatch(const G13_ActionPtr& action, bool is_down) {
+		if (!action) {
+			return;
+		}
+
+		if (action->realtime() || !on_input_thread()) {
+			action->act(is_down, *this);
+			return;
+		}
+
+		// Presses leave room for releases, a key must never stay pressed
+		if (is_down && _deferred.size() >= G13_DEFERRED_QUEUE_SIZE - G13_DEFERRED_RELEASE_RESERVE) {
+			_logger->warning("Deferred action queue is full, dropping press");
+			return;
+		}
+		if (!_deferred.push({action, is_down})) {
+			_logger->error("Deferred action queue is full, releasing on the input thread");
+			action->act(false, *this);
+			return;
+		}
+		const uint64_t one = 1;
+		write(_deferred_fd, &one, sizeof(one));
+	}
+
+	void G13_Device::run_deferred() {
+		uint64_t count;
+		read(_deferred_fd, &count, sizeof(count));
+
+		with_input_paused([this] {
+			DeferredAction deferred;
+			while (_deferred.pop(deferred)) {
+				deferred.action->act(deferred.is_down, *this);
 			}
-			// Ignoring these for now
-			case LIBUSB_TRANSFER_ERROR:
-			case LIBUSB_TRANSFER_TIMED_OUT:
-			case LIBUSB_TRANSFER_CANCELLED:
-			case LIBUSB_TRANSFER_STALL:
-			case LIBUSB_TRANSFER_NO_DEVICE:
-			case LIBUSB_TRANSFER_OVERFLOW:
+		});
+	}
+
+	bool G13_Device::start_input_thread(int rt_priority) {
+		if (_input_thread.joinable()) {
+			return true;
+		}
+
+		_input_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		_deferred_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (_input_wake_fd == -1 || _deferred_fd == -1) {
+			_logger->error(std::string("Failed creating input thread eventfds: ") + std::strerror(errno));
+			return false;
+		}
+
+		_input_loop = std::make_unique<G13_EventLoop>(_logger);
+		if (libusb_context* ctx = _backend->usb_context()) {
+			_input_loop->watch_usb(ctx);
+		}
+		_input_loop->add_fd(_input_wake_fd, EPOLLIN, [this](uint32_t) {
+			uint64_t count;
+			read(_input_wake_fd, &count, sizeof(count));
+		});
+		attach_timers(*_input_loop);
+
+		_input_stop = false;
+		_input_thread = std::thread(&G13_Device::input_thread_main, this);
+
+		if (rt_priority > 0) {
+			sched_param param{};
+			param.sched_priority = rt_priority;
+			if (const int error = pthread_setschedparam(_input_thread.native_handle(), SCHED_FIFO, &param); error != 0) {
+				_logger->warning("Could not set SCHED_FIFO priority " + std::to_string(rt_priority) + " for input thread: " + std::strerror(error));
+			}
+		}
+
+		_logger->info("Started input thread for G13 " + std::to_string(id_within_manager()));
+		return true;
+	}
+
+	void G13_Device::stop_input_thread() {
+		if (_input_thread.joinable()) {
+			_input_stop = true;
+			const uint64_t one = 1;
+			write(_input_wake_fd, &one, sizeof(one));
+			_input_thread.join();
+		}
+
+		_input_loop.reset();
+		_timer_fd = -1;
+		if (_input_wake_fd != -1) {
+			close(_input_wake_fd);
+			_input_wake_fd = -1;
+		}
+		if (_deferred_fd != -1) {
+			close(_deferred_fd);
+			_deferred_fd = -1;
+		}
+	}
+
+	void G13_Device::input_thread_main() {
+		_input_thread_id.store(std::this_thread::get_id(), std::memory_order_release);
+		while (!_input_stop.load(std::memory_order_relaxed)) {
+			if (_input_pause_requested.load(std::memory_order_acquire)) {
+				// Park until the worker has finished changing shared state
+				_input_paused.store(true, std::memory_order_release);
+				_input_paused.notify_one();
+				_input_pause_requested.wait(true, std::memory_order_acquire);
+				_input_paused.store(false, std::memory_order_release);
+				continue;
+			}
+
+			if (_input_loop->run_once() < 0 || _input_loop->usb_failed()) {
+				_logger->error("Input thread for G13 " + std::to_string(id_within_manager()) + " stopped");
 				break;
+			}
 		}
 
-		// Resubmit transfer for next update
-		int error = libusb_submit_transfer(transfer);
-		if (error && error != LIBUSB_ERROR_TIMEOUT) {
-			device->logger()->error("Error while reading keys (during resubmit): " + std::to_string(error) + " ("
-								   + device->describe_libusb_error_code(error) + ")");
-		}
-	}
-
-	/*!
-	 * creates, fills and submits the initial data transfer for the device
-	 * @see https://libusb.sourceforge.io/api-1.0/group__libusb__asyncio.html#details
-	 */
-	int G13_Device::read_keys() {
-		// Return if transfer has already been allocated
-		if (transfer != nullptr)
-			return 0;
-
-		transfer = libusb_alloc_transfer(0);
-		// pass the current device (this) along as user_data, so we can manipulate it later
-		libusb_fill_interrupt_transfer(transfer,
-									   handle,
-									   LIBUSB_ENDPOINT_IN | G13_KEY_ENDPOINT,
-									   this->key_buffer,
-									   G13_REPORT_SIZE,
-									   transfer_cb,
-									   this,
-									   100);
-
-		int error = libusb_submit_transfer(transfer);
-		if (error && error != LIBUSB_ERROR_TIMEOUT) {
-			_logger->error("Error while reading keys: " + std::to_string(error) + " ("
-														+ describe_libusb_error_code(error) + ")");
-			libusb_free_transfer(transfer);
-			return -1;
+		// A later thread may get the same id
+		_input_thread_id.store(std::thread::id(), std::memory_order_release);
+
+		// Never leave the worker waiting for a thread that is gone
+		_input_paused.store(true, std::memory_order_release);
+		_input_paused.notify_one();
+	}
+
+	void G13_Device::with_input_paused(const std::function<void()>& fn) {
+		if (!_input_thread.joinable() || on_input_thread() || _pause_depth > 0) {
+			fn();
+			return;
+		}
+
+		_input_pause_requested.store(true, std::memory_order_release);
+		const uint64_t one = 1;
+		write(_input_wake_fd, &one, sizeof(one));
+		_input_paused.wait(false, std::memory_order_acquire);
+
+		_pause_depth++;
+		fn();
+		_pause_depth--;
+
+		_input_pause_requested.store(false, std::memory_order_release);
+		_input_pause_requested.notify_one();
+	}
+
+	bool G13_Device::attach_timers(G13_EventLoop& loop) {
+		_timer_fd = loop.add_timer([this] {
+			run_timers();
+		});
+		if (_timer_fd == -1) {
+			return false;
+		}
+		arm_timers();
+		return true;
+	}
+
+	G13_TimerWheel::TimerId G13_Device::schedule_timer(std::chrono::milliseconds delay, G13_TimerWheel::TIMER_CALLBACK callback,
+													   std::chrono::milliseconds interval) {
+		const auto when = G13_TimerWheel::Clock::now() + delay;
+		const bool earliest = when < _timers.next_expiry();
+		const G13_TimerWheel::TimerId id = _timers.schedule(when, std::move(callback), interval);
+		if (earliest) {
+			arm_timers();
 		}
+		return id;
+	}
 
-		return 0;
+	G13_TimerWheel::TimerId G13_Device::schedule_timer_at(G13_TimerWheel::Clock::time_point when,
+														  G13_TimerWheel::TIMER_CALLBACK callback) {
+		const bool earliest = when < _timers.next_expiry();
+		const G13_TimerWheel::TimerId id = _timers.schedule(when, std::move(callback));
+		if (earliest) {
+			arm_timers();
+		}
+		return id;
+	}
+
+	void G13_Device::cancel_timer(G13_TimerWheel::TimerId id) {
+		// Leaving the timerfd armed only costs one spurious wakeup
+		if (id != G13_TimerWheel::NO_TIMER) {
+			_timers.cancel(id);
+		}
+	}
+
+	void G13_Device::run_timers() {
+		timeval time{};
+		gettimeofday(&time, nullptr);
+		begin_events(time);
+		_timers.expire(G13_TimerWheel::Clock::now());
+		end_events();
+		arm_timers();
+	}
+
+	void G13_Device::arm_timers() {
+		if (_timer_fd == -1) {
+			return;
+		}
+
+		const auto next = _timers.next_expiry();
+		if (next == G13_TimerWheel::Clock::time_point::max()) {
+			G13_EventLoop::arm_timer(_timer_fd, std::chrono::nanoseconds::zero());
+			return;
+		}
+		// Zero would disarm the timer, fire as soon as possible instead
+		const auto delay = next - G13_TimerWheel::Clock::now();
+		G13_EventLoop::arm_timer(_timer_fd, std::max<G13_TimerWheel::Clock::duration>(delay, std::chrono::nanoseconds(1)));
 	}
 
 	void G13_Device::read_config_file(const std::string& filename) {
@@ -464,32 +657,62 @@ namespace G13 {
 		}
 	}
 
+	G13_Device::CommandReply G13_Device::execute(const std::string& line) {
+		CommandReply reply;
+		G13_ErrorCapture errors;
+		_command_output = &reply.output;
+		_command_fds = &reply.fds;
+		with_input_paused([&] {
+			_logger->info("command: " + line);
+			command(line.c_str());
+		});
+		_command_output = nullptr;
+		_command_fds = nullptr;
+
+		if (errors.failed()) {
+			reply.ok = false;
+			reply.output = errors.errors();
+			reply.fds.clear();
+		}
+		return reply;
+	}
+
 	void G13_Device::read_commands() {
-		fd_set set;
-		FD_ZERO(&set);
-		FD_SET(_input_pipe_fid, &set);
-		struct timeval tv;
-		tv.tv_sec = 0;
-		tv.tv_usec = 0;
-		int ret = select(_input_pipe_fid + 1, &set, 0, 0, &tv);
-		if (ret > 0) {
-			unsigned char buf[1024 * 1024];
-			memset(buf, 0, 1024 * 1024);
-			ret = read(_input_pipe_fid, buf, 1024 * 1024);
-			_logger->trace("read " + std::to_string(ret) + " characters");
-
-			if (ret == 960) { // TODO probably image, for now, don't test, just assume image
-				lcd().image(buf, ret);
-			} else {
-				std::string buffer = reinterpret_cast<const char*>(buf);
-				std::stringstream lines(buffer);
-				std::string line;
-				while (getline(lines, line, '\n')) {
-					std::string cmd = line.substr(0, line.find('#'));
-					_logger->info("command: " + cmd);
-					command(cmd.c_str());
-				}
+		// Read straight into the decoder, behind what is left of an incomplete line or frame
+		const std::span<unsigned char> space = _input_decoder.space();
+		const ssize_t ret = read(_input_pipe_fid, space.data(), space.size());
+		if (ret <= 0) {
+			return;
+		}
+		G13_LOG_TRACE(_logger, "read " + std::to_string(ret) + " characters");
+
+		// Only on request, a command line of exactly that length would be taken for an image too
+		if (_raw_lcd_images && ret == G13_LCD_BUFFER_SIZE && _input_decoder.empty() &&
+			memcmp(space.data(), G13_INPUT_MAGIC, sizeof(G13_INPUT_MAGIC)) != 0) {
+			lcd().image(space.data(), G13_LCD_BUFFER_SIZE);
+			return;
+		}
+
+		_input_decoder.commit(ret);
+		G13_InputMessage message;
+		bool more = _input_decoder.next(message);
+		while (more) {
+			if (message.type == G13_INPUT_LCD) {
+				lcd().image(message.data, message.size);
+				more = _input_decoder.next(message);
+				continue;
 			}
+
+			// Commands that arrived together run in one pause of the input thread
+			with_input_paused([&] {
+				while (more && message.type == G13_INPUT_COMMANDS) {
+					if (!message.command.empty()) {
+						G13_LOG(_logger, LogLevel::info, "command: " + std::string(message.command));
+						command(message.command.data());
+					}
+					more = _input_decoder.next(message);
+				}
+			});
 		}
 	}
 
@@ -513,6 +736,7 @@ namespace G13 {
 		if (_current_profile->guid() != id) {
 			_current_profile = profile(id);
 			_logger->info("Profile switched to: " + _current_profile->name() + " (" + id + ")");
+			request_redraw();
 		}
 	}
 
@@ -528,9 +752,24 @@ namespace G13 {
 	void G13_Device::dump(std::ostream& o, int detail) {
 		o << "G13 id=" << id_within_manager() << endl;
 		o << "   input_pipe_name=" << repr(_input_pipe_name) << endl;
+		o << "   input frames=" << _input_decoder.stats().frames << " commands=" << _input_decoder.stats().commands
+		  << " errors=" << _input_decoder.stats().errors << endl;
 		o << "   output_pipe_name=" << repr(_output_pipe_name) << endl;
 		o << "   current_profile=" << _current_profile->name() << endl;
 		o << "   current_font=" << lcd().current_font().name() << std::endl;
+		o << "   backend=" << _backend->name() << std::endl;
+		if (_shared_framebuffer) {
+			_shared_framebuffer->dump(o);
+		}
+		_backend->dump(o);
+		o << "   lcd_frames rendered=" << lcd().frame_stats().rendered << " sent=" << lcd().frame_stats().sent
+		  << " skipped=" << lcd().frame_stats().skipped << std::endl;
+		const auto& zone_stats = stick().zone_stats();
+		const uint64_t transitions = zone_stats.transitions.load(std::memory_order_relaxed);
+		const uint64_t unfiltered = zone_stats.unfiltered_transitions.load(std::memory_order_relaxed);
+		o << "   stick_zones transitions=" << transitions
+		  << " suppressed=" << (unfiltered > transitions ? unfiltered - transitions : 0)
+		  << " filter=" << stick().filter_description() << std::endl;
 
 		if (detail > 0) {
 			o << "STICK" << std::endl;
@@ -565,11 +804,26 @@ namespace G13 {
 			std::string keyname;
 			advance_ws(remainder, keyname);
 			std::string action = remainder;
+
+			// M1:G1 binds G1 in the M1 layer only
+			int layer = -1;
+			std::string bound_keyname = keyname;
+			if (keyname.size() > 3 && keyname[0] == 'M' && keyname[2] == ':' && keyname[1] >= '1' && keyname[1] < '1' + G13_NUM_LAYERS) {
+				layer = keyname[1] - '1';
+				bound_keyname = keyname.substr(3);
+			}
 			try {
-				if (auto key = _current_profile->find_key(keyname)) {
+				if (auto key = _current_profile->find_key(bound_keyname)) {
 					vector<std::string> excluded{"BD", "L1", "L2", "L3", "L4"};
-					if (ranges::find(excluded, keyname) == excluded.end())
-						key->set_action(make_action(action));
+					if (ranges::find(excluded, bound_keyname) == excluded.end()) {
+						if (layer >= 0) {
+							_current_profile->set_layer_action(layer, key->index(), make_action(action));
+						} else {
+							key->set_action(make_action(action));
+						}
+					}
+				} else if (layer >= 0) {
+					return _logger->error("bind " + keyname + " : layers only apply to keys");
 				} else if (auto stick_key = _stick->zone(keyname)) {
 					stick_key->set_action(make_action(action));
 				} else {
@@ -581,6 +835,62 @@ namespace G13 {
 			}
 		};
 
+		_command_table["bindhold"] = [this](const char* remainder) {
+			std::string keyname;
+			advance_ws(remainder, keyname);
+			const auto key = _current_profile->find_key(keyname);
+			if (!key) {
+				return _logger->error("bindhold key " + keyname + " unknown");
+			}
+
+			std::string delay;
+			advance_ws(remainder, delay);
+			try {
+				if (delay == "off") {
+					_current_profile->set_hold_action(key->index(), std::chrono::milliseconds::zero(), nullptr);
+					return;
+				}
+				char* end;
+				const long ms = strtol(delay.c_str(), &end, 10);
+				if (delay.empty() || *end || ms <= 0) {
+					return _logger->error("bindhold " + keyname + " bad delay: " + delay);
+				}
+				_current_profile->set_hold_action(key->index(), std::chrono::milliseconds(ms), make_action(remainder));
+			} catch (const std::exception& ex) {
+				return _logger->error("bindhold " + keyname + " failed: " + ex.what());
+			}
+		};
+
+		_command_table["bindchord"] = [this](const char* remainder) {
+			std::string chord;
+			advance_ws(remainder, chord);
+			uint64_t keys = 0;
+			std::stringstream buffer(chord);
+			std::string keyname;
+			while (getline(buffer, keyname, '+')) {
+				const auto key = _current_profile->find_key(keyname);
+				if (!key) {
+					return _logger->error("bindchord key " + keyname + " unknown");
+				}
+				keys |= uint64_t(1) << key->index();
+			}
+
+			try {
+				const std::string action = remainder;
+				_current_profile->set_chord_action(keys, action == "off" ? nullptr : make_action(action));
+			} catch (const std::exception& ex) {
+				return _logger->error("bindchord " + chord + " failed: " + ex.what());
+			}
+		};
+
+		_command_table["chord_timeout"] = [this](const char* remainder) {
+			int timeout;
+			if (sscanf(remainder, "%i", &timeout) != 1 || timeout <= 0) {
+				return _logger->error("bad chord_timeout : " + std::string(remainder));
+			}
+			_key_bindings->set_chord_timeout(std::chrono::milliseconds(timeout));
+		};
+
 		_command_table["profile"] = [this](const char* remainder) {
 			switch_to_profile(command_argument(remainder));
 		};
@@ -589,6 +899,14 @@ namespace G13 {
 			switch_to_font(remainder);
 		};
 
+		_command_table["layer"] = [this](const char* remainder) {
+			int layer;
+			if (sscanf(remainder, "%i", &layer) != 1 || layer < 1 || layer > G13_NUM_LAYERS) {
+				return _logger->error("bad layer : " + std::string(remainder));
+			}
+			set_layer(layer - 1);
+		};
+
 		_command_table["mod"] = [this](const char* remainder) {
 			set_mode_leds(atoi(remainder));
 		};
@@ -611,6 +929,7 @@ namespace G13 {
 
 			if (mode == "ABSOLUTE") { return _stick->set_mode(STICK_ABSOLUTE); }
 			if (mode == "RELATIVE") { return _stick->set_mode(STICK_RELATIVE); }
+			if (mode == "SCROLL") { return _stick->set_mode(STICK_SCROLL); }
 			if (mode == "KEYS") { return _stick->set_mode(STICK_KEYS); }
 			if (mode == "CALCENTER") { return _stick->set_mode(STICK_CALCENTER); }
 			if (mode == "CALBOUNDS") { return _stick->set_mode(STICK_CALBOUNDS); }
@@ -619,6 +938,30 @@ namespace G13 {
 			return _logger->error("unknown stick mode : <" + mode + ">");
 		};
 
+		_command_table["stickfilter"] = [this](const char* remainder) {
+			std::string filter;
+			advance_ws(remainder, filter);
+			_stick->set_filter(filter, remainder);
+		};
+
+		_command_table["stickdeadzone"] = [this](const char* remainder) {
+			double deadzone;
+			if (sscanf(remainder, "%lf", &deadzone) != 1) {
+				throw G13_CommandException("bad stickdeadzone value");
+			}
+			_stick->set_deadzone(deadzone);
+		};
+
+		_command_table["stickmotion"] = [this](const char* remainder) {
+			std::string option;
+			advance_ws(remainder, option);
+			double value;
+			if (sscanf(remainder, "%lf", &value) != 1) {
+				throw G13_CommandException("bad stickmotion value");
+			}
+			_stick->set_motion_option(option, value);
+		};
+
 		_command_table["stickzone"] = [this](const char* remainder) {
 			std::string operation, zonename;
 			advance_ws(remainder, operation);
@@ -638,8 +981,20 @@ namespace G13 {
 						throw G13_CommandException("bad bounds format");
 					}
 					zone->set_bounds(G13_ZoneBounds(x1, y1, x2, y2));
+				} else if (operation == "hysteresis") {
+					double enter_margin, exit_margin;
+					if (sscanf(remainder, "%lf %lf", &enter_margin, &exit_margin) != 2 || enter_margin < 0.0 || exit_margin < 0.0) {
+						throw G13_CommandException("bad hysteresis format");
+					}
+					zone->set_hysteresis(enter_margin, exit_margin);
+				} else if (operation == "repeat") {
+					int delay, interval;
+					if (sscanf(remainder, "%i %i", &delay, &interval) != 2 || delay < 0 || interval < 0) {
+						throw G13_CommandException("bad repeat format");
+					}
+					zone->set_repeat(std::chrono::milliseconds(delay), std::chrono::milliseconds(interval));
 				} else if (operation == "del") {
-					_stick->remove_zone(*zone);
+					_stick->remove_zone(*this, *zone);
 				} else {
 					return _logger->error("unknown stickzone operation: <" + operation + ">");
 				}
@@ -649,15 +1004,19 @@ namespace G13 {
 		_command_table["dump"] = [this](const char* remainder) {
 			std::string target;
 			advance_ws(remainder, target);
+			int detail;
 			if (target == "all") {
-				dump(std::cout, 3);
+				detail = 3;
 			} else if (target == "current") {
-				dump(std::cout, 1);
+				detail = 1;
 			} else if (target == "summary") {
-				dump(std::cout, 0);
+				detail = 0;
 			} else {
 				return _logger->error("unknown dump target: <" + target + ">");
 			}
+			std::ostringstream out;
+			dump(out, detail);
+			write_output_pipe(out.str());
 		};
 
 		_command_table["log_level"] = [this](const char* remainder) {
@@ -667,7 +1026,40 @@ namespace G13 {
 		};
 
 		_command_table["refresh"] = [this](const char* remainder) {
-			lcd().image_send();
+			lcd().image_send(true);
+		};
+
+		_command_table["max_fps"] = [this](const char* remainder) {
+			int max_fps;
+			if (sscanf(remainder, "%i", &max_fps) != 1 || max_fps <= 0) {
+				return _logger->error("bad max_fps : " + std::string(remainder));
+			}
+			set_max_fps(max_fps);
+		};
+
+		_command_table["macro"] = [this](const char* remainder) {
+			std::string operation;
+			advance_ws(remainder, operation);
+			if (operation == "stop") {
+				// Releases every key the running macros still hold
+				_macros->cancel_all();
+			} else {
+				return _logger->error("unknown macro operation: <" + operation + ">");
+			}
+		};
+
+		_command_table["stats"] = [this](const char* remainder) {
+			std::string operation;
+			advance_ws(remainder, operation);
+			if (operation == "reset") {
+				_latency.reset();
+			} else if (operation.empty()) {
+				std::ostringstream out;
+				_latency.dump(out);
+				write_output_pipe(out.str());
+			} else {
+				return _logger->error("unknown stats operation: <" + operation + ">");
+			}
 		};
 
 		_command_table["clear"] = [this](const char* remainder) {
@@ -679,6 +1071,53 @@ namespace G13 {
 			reload_profile(command_argument(remainder));
 		};
 
+		// Headless testing with the memory backend: feed key reports, read back the events
+		_command_table["inject"] = [this](const char* remainder) {
+			auto* memory = dynamic_cast<G13_MemoryBackend*>(_backend.get());
+			if (!memory) {
+				return _logger->error("inject needs the memory backend");
+			}
+			unsigned char report[G13_REPORT_SIZE];
+			unsigned int byte;
+			int consumed;
+			for (unsigned char& value : report) {
+				if (sscanf(remainder, " %2x%n", &byte, &consumed) != 1) {
+					return _logger->error("bad report, expected " + std::to_string(G13_REPORT_SIZE) + " hex bytes");
+				}
+				value = byte;
+				remainder += consumed;
+			}
+			with_input_paused([&] {
+				memory->memory_keys().inject(report);
+			});
+		};
+
+		_command_table["captured"] = [this](const char* remainder) {
+			auto* memory = dynamic_cast<G13_MemoryBackend*>(_backend.get());
+			if (!memory) {
+				return _logger->error("captured needs the memory backend");
+			}
+			std::string out;
+			for (const input_event& event : memory->memory_events().take_events()) {
+				out += std::format("{} {} {}\n", event.type, event.code, event.value);
+			}
+			write_output_pipe(out);
+		};
+
+		_command_table["framebuffer"] = [this](const char* remainder) {
+			if (!_shared_framebuffer) {
+				return _logger->error("no shared framebuffer, it needs the control socket");
+			}
+			if (!_command_fds) {
+				return _logger->error("framebuffer only works on the control socket");
+			}
+			// The client maps the first descriptor and rings the second
+			_command_fds->push_back(_shared_framebuffer->memory_fd());
+			_command_fds->push_back(_shared_framebuffer->doorbell_fd());
+			write_output_pipe(std::format("framebuffer size={} sequence={}\n", _shared_framebuffer->size(),
+										  _shared_framebuffer->sequence()));
+		};
+
 		/* TODO add more commands
 		 * New command template:
 			_command_table[""] = [this](const char *remainder) {
@@ -723,17 +1162,30 @@ namespace G13 {
 			return Container::Instance().Resolve<G13_Action_Command>(action.substr(1));
 		}
 
+		if (action.starts_with("turbo:")) {
+			return Container::Instance().Resolve<G13_Action_Turbo>(action.substr(6));
+		}
+
+		if (action[0] == '@') {
+			auto macro = G13_Macro::parse(action.substr(1), *Container::Instance().Resolve<G13_KeyMap>());
+			if (macro->empty()) {
+				throw G13_CommandException("empty macro");
+			}
+			return Container::Instance().Resolve<G13_Action_Macro>(G13_MacroPtr(macro));
+		}
+
 		return Container::Instance().Resolve<G13_Action_Keys>(action);
 	}
 
-	inline bool G13_Device::is_set(int key) {
-		return keys[key];
+	bool G13_Device::update(int key, bool v) {
+		const uint64_t bit = uint64_t(1) << key;
+		return update_keys(v ? _key_state | bit : _key_state & ~bit) != 0;
 	}
 
-	bool G13_Device::update(int key, bool v) {
-		bool old = keys[key];
-		keys[key] = v;
-		return old != v;
+	uint64_t G13_Device::update_keys(uint64_t state) {
+		const uint64_t changed = _key_state ^ state;
+		_key_state = state;
+		return changed;
 	}
 
 	void G13_Device::_init_apps() {
@@ -751,6 +1203,7 @@ namespace G13 {
 
 		// Call init of the app
 		this->_apps[this->current_app]->init(*this);
+		_redraw_on_stick = this->_apps[this->current_app]->redraw_on_stick_move();
 	}
 
 	unsigned int G13_Device::get_current_app() const {
@@ -760,10 +1213,61 @@ namespace G13 {
 	void G13_Device::next_app() {
 		this->current_app = ++this->current_app % this->_apps.size();
 		this->_apps[this->current_app]->init(*this);
+		_redraw_on_stick = this->_apps[this->current_app]->redraw_on_stick_move();
+		request_redraw();
 	}
 
 	void G13_Device::display_app() {
-		this->_apps[this->current_app]->display(*this);
+		using std::chrono::steady_clock;
+
+		_redraw_requested = false;
+		const steady_clock::time_point now = steady_clock::now();
+		_last_render = now.time_since_epoch().count();
+
+		const G13_DisplayApp::Deadline deadline = this->_apps[this->current_app]->display(*this);
+
+		if (deadline != G13_DisplayApp::NO_DEADLINE) {
+			schedule_display(deadline);
+		} else if (_display_timer_fd != -1) {
+			G13_EventLoop::arm_timer(_display_timer_fd, std::chrono::nanoseconds::zero());
+		}
+
+		// A redraw requested while rendering may have been overwritten by the re-arm above
+		if (_redraw_requested) {
+			schedule_display(now);
+		}
+	}
+
+	void G13_Device::set_display_timer(int timer_fd, int max_fps) {
+		_display_timer_fd = timer_fd;
+		set_max_fps(max_fps);
+		// Redraws requested before the timer existed could not schedule anything, start over
+		_redraw_requested = false;
+		request_redraw();
+	}
+
+	void G13_Device::set_max_fps(int max_fps) {
+		const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / std::max(max_fps, 1);
+		_min_frame_interval = interval.count();
+	}
+
+	void G13_Device::request_redraw() {
+		if (!_redraw_requested.exchange(true)) {
+			schedule_display(std::chrono::steady_clock::now());
+		}
+	}
+
+	void G13_Device::schedule_display(std::chrono::steady_clock::time_point when) {
+		using std::chrono::steady_clock;
+
+		if (_display_timer_fd == -1) {
+			return;
+		}
+
+		const steady_clock::time_point earliest(steady_clock::duration(_last_render + _min_frame_interval));
+		const steady_clock::duration delay = std::max(when, earliest) - steady_clock::now();
+		// Zero would disarm the timer, fire as soon as possible instead
+		G13_EventLoop::arm_timer(_display_timer_fd, std::max(delay, steady_clock::duration(1)));
 	}
 
 	void G13_Device::init_profiles() {
@@ -793,11 +1297,18 @@ namespace G13 {
 			_current_profile = profile;
 		}
 
+		auto keymap = Container::Instance().Resolve<G13_KeyMap>();
 		pugi::xpath_node_set assignments = doc.select_nodes("/profiles/profile/assignments[@devicecategory='Logitech.Gaming.LeftHandedController']/assignment[@backup='false']");
 
 		for (auto node : assignments) {
 			// Find G Key
 			std::string keyname = node.node().attribute("contextid").value();
+			// Shift state 1 (M1) is the key's own binding, M2 and M3 only override it in their layer
+			const int layer = node.node().attribute("shiftstate").as_int(1) - 1;
+			if (layer < 0 || layer >= G13_NUM_LAYERS) {
+				_logger->warning(std::format("bind {} unknown shift state {}", keyname, layer + 1));
+				continue;
+			}
 			// TODO stick zones are dynamic and troublesome for this
 			// keymap for converting from Logitech -> g13/key
 			std::map<std::string, std::string> gkey_convert_map = {
@@ -827,58 +1338,98 @@ namespace G13 {
 					{"ESCAPE", "ESC"}
 			};
 
-			// TODO handle key direction and timings
 			// Get macro from XML
 			std::string macroguid = node.node().attribute("macroguid").value();
 			std::string macro_query = "/profiles/profile/macros/macro[@guid='"+macroguid+"']";
-			pugi::xpath_node_set macro = doc.select_nodes(macro_query.c_str());
+			pugi::xml_node macro_node = doc.select_node(macro_query.c_str()).node();
 
 			std::string action;
-			for(auto keyset : macro) {
-				// Check for support: only multikey and keystroke elements for now
-				auto keys = keyset.node().first_child();
-				if (strcmp(keys.name(), "multikey") != 0 and strcmp(keys.name(), "keystroke") != 0) {
-					_logger->warning(std::format("Macro not supported: {}", keys.name()));
-					continue;
-				}
+			try {
+				// Keys without a direction form a combination held as long as the G key, directions
+				// and delays need a timed macro
+				auto macro = std::make_shared<G13_Macro>();
+				std::vector<std::string> combination;
+				bool timed = false;
+				for (auto keys : macro_node.children()) {
+					if (keys.type() != pugi::node_element) {
+						continue;
+					}
+					if (strcmp(keys.name(), "multikey") != 0 and strcmp(keys.name(), "keystroke") != 0) {
+						_logger->warning(std::format("Macro not supported: {}", keys.name()));
+						continue;
+					}
 
-				// Gather unique keys only
-				std::set<std::string> unique_keys;
-				for (auto keystroke : keys.children("key")) {
-					// Extract value and add to set
-					unique_keys.emplace(keystroke.attribute("value").value());
+					for (auto element : keys.children()) {
+						if (strcmp(element.name(), "delay") == 0) {
+							macro->add_delay(std::chrono::milliseconds(element.attribute("milliseconds").as_uint()));
+							timed = true;
+							continue;
+						}
+						if (strcmp(element.name(), "key") != 0) {
+							continue;
+						}
+
+						// Convert if necessary and add prefix
+						std::string key = element.attribute("value").value();
+						if (key_convert_map.count(key) > 0)
+							key = key_convert_map.at(key);
+						key.insert(0, "KEY_");
+
+						const LINUX_KEY_VALUE kval = keymap->find_input_key_value(key);
+						if (kval == BAD_KEY_VALUE) {
+							throw G13_CommandException("create action unknown key : " + key);
+						}
+						const std::string direction = element.attribute("direction").value();
+						if (direction == "down" || direction == "up") {
+							macro->add_key(kval, direction == "down");
+							timed = true;
+						} else {
+							macro->add_tap(kval);
+							if (ranges::find(combination, key) == combination.end())
+								combination.push_back(key);
+						}
+					}
 				}
 
 				// Build action
-				for (auto key : unique_keys) {
-					// Convert if necessary
-					if (key_convert_map.count(key) > 0)
-						key = key_convert_map.at(key);
-
-					// Add prefix
-					key.insert(0, "KEY_");
-
-					// Add operator
-					if (!action.empty())
-						action += "+";
-
-					// Add keystroke
-					action += key;
+				G13_ActionPtr action_ptr;
+				if (timed) {
+					std::ostringstream description;
+					macro->dump(description, *keymap);
+					action = description.str();
+					action_ptr = Container::Instance().Resolve<G13_Action_Macro>(G13_MacroPtr(macro));
+				} else {
+					for (const auto& key : combination) {
+						// Add operator
+						if (!action.empty())
+							action += "+";
+						action += key;
+					}
+					action_ptr = make_action(action);
 				}
-			}
 
-			// Bind keys to actions
-			try {
+				// Bind keys to actions
 				if (auto gkey = profile->find_key(keyname)) {
 					vector<std::string> excluded {"BD", "L1", "L2", "L3", "L4"};
-					if (ranges::find(excluded, keyname) == excluded.end())
-						gkey->set_action(make_action(action));
+					if (ranges::find(excluded, keyname) == excluded.end()) {
+						if (layer == 0) {
+							gkey->set_action(action_ptr);
+						} else {
+							profile->set_layer_action(layer, gkey->index(), action_ptr);
+						}
+					}
 				} else if (auto stick_key = stick().zone(keyname)) {
-					stick_key->set_action(make_action(action));
+					// Stick zones belong to the device and have no layers
+					if (layer == 0) {
+						stick_key->set_action(action_ptr);
+					} else {
+						_logger->debug(std::format("bind {} ignored for shift state {}", keyname, layer + 1));
+						continue;
+					}
 				} else {
 					_logger->warning("bind key " + keyname + " unknown");
 				}
-				_logger->debug(std::format("bind {} [{}]", keyname, action));
+				_logger->debug(std::format("bind M{}:{} [{}]", layer + 1, keyname, action));
 			} catch (const std::exception& ex) {
 				_logger->error(std::format("bind {} [{}] failed : {}", keyname, action, ex.what()));
 			}
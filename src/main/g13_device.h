@@ -5,26 +5,40 @@
 #ifndef G13_G13_DEVICE_H
 #define G13_G13_DEVICE_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
-#include <libusb-1.0/libusb.h>
 #include <linux/uinput.h>
+#include <sys/time.h>
 
+#include "g13_input_decoder.h"
+#include "g13_latency.h"
 #include "g13_lcd.h"
+#include "g13_spsc_queue.h"
+#include "g13_timer_wheel.h"
+#include "g13_transport.h"
 
 namespace G13 {
 	// Forward declarations
 	class G13_Action;
 	class G13_DisplayApp;
+	class G13_EventLoop;
 	class G13_Font;
 	class G13_Log;
+	class G13_KeyBindingState;
 	class G13_LCD;
+	class G13_MacroPlayer;
 	class G13_Manager;
 	class G13_Profile;
+	class G13_ReportRecorder;
+	class G13_SharedFramebuffer;
 	class G13_Stick;
 
 	typedef std::shared_ptr<G13_Action> G13_ActionPtr;
@@ -39,13 +53,14 @@ namespace G13 {
 	const size_t G13_PRODUCT_ID = 0xc21c;
 	const size_t G13_REPORT_SIZE = 8;
 	const size_t G13_LCD_BUFFER_SIZE = 0x3c0;
+	const size_t G13_LCD_HEADER_SIZE = 32;
 	const size_t G13_NUM_KEYS = 40;
-
-	/**
-	 * @brief Handles completion of an asynchronous libusb key transfer.
-	 * @param transfer completed libusb transfer.
-	 */
-	void transfer_cb(libusb_transfer* transfer);
+	const size_t G13_KEY_TRANSFERS = 4;
+	const size_t G13_DEFERRED_QUEUE_SIZE = 256;
+	// deferred queue slots only releases may use, more than keys, stick zones and bindings can hold at once
+	const size_t G13_DEFERRED_RELEASE_RESERVE = 128;
+	const int G13_DEFAULT_MAX_FPS = 30;
+	const size_t G13_EVENT_BATCH_SIZE = 64;
 
 	/**
 	 * @brief Runtime representation of one connected Logitech G13 device.
@@ -53,13 +68,13 @@ namespace G13 {
 	class G13_Device {
 	public:
 		/**
-		 * @brief Creates a device wrapper around an open libusb handle.
+		 * @brief Creates a device that talks through the given backend.
 		 * @param logger logger used for device diagnostics.
-		 * @param handle open libusb device handle.
+		 * @param backend transports of the device, a real G13 or memory.
 		 * @param id device index assigned by the manager.
 		 * @param profiles_dir directory containing profile XML files.
 		 */
-		G13_Device(std::shared_ptr<G13_Log> logger, libusb_device_handle* handle, unsigned long id, std::string profiles_dir);
+		G13_Device(std::shared_ptr<G13_Log> logger, std::unique_ptr<G13_Backend> backend, unsigned long id, std::string profiles_dir);
 
 		/**
 		 * @brief Releases device resources owned by this wrapper.
@@ -96,6 +111,24 @@ namespace G13 {
 		 */
 		const G13_Stick& stick() const { return *_stick; }
 
+		/**
+		 * @brief Gets the player running this device's macros. Only use from the input side, like schedule_timer.
+		 * @return macro player.
+		 */
+		G13_MacroPlayer& macros() { return *_macros; }
+
+		/**
+		 * @brief Gets the state machine resolving tap/hold and chord bindings. Only use from the input side.
+		 * @return key binding state.
+		 */
+		G13_KeyBindingState& key_bindings() { return *_key_bindings; }
+
+		/**
+		 * @brief Gets the transports the device talks through.
+		 * @return device backend.
+		 */
+		G13_Backend& backend() { return *_backend; }
+
 		/**
 		 * @brief Gets the device logger.
 		 * @return shared logger instance.
@@ -143,10 +176,52 @@ namespace G13 {
 		void command(char const* str);
 
 		/**
-		 * @brief Reads pending commands from the input FIFO.
+		 * @brief Outcome of a command run through execute.
+		 */
+		struct CommandReply {
+			bool ok = true;
+			// what the command wrote to the output pipe, or its errors when it failed
+			std::string output;
+			// descriptors to pass to the client along with the reply, owned by the device
+			std::vector<int> fds;
+		};
+
+		/**
+		 * @brief Runs one command with the input thread paused and collects its result instead of
+		 * writing it to the output pipe. Errors the command logs make it fail.
+		 * @param line command text.
+		 * @return status and output of the command.
+		 */
+		CommandReply execute(const std::string& line);
+
+		/**
+		 * @brief Reads pending commands from the input FIFO. Called when the FIFO is readable.
 		 */
 		void read_commands();
 
+		/**
+		 * @brief Gets the input FIFO descriptor so it can be watched by the event loop.
+		 * @return input FIFO descriptor, or -1 when the FIFO could not be opened.
+		 */
+		int input_pipe_fd() const { return _input_pipe_fid; }
+
+		/**
+		 * @brief Creates the shared framebuffer that control socket clients can draw into.
+		 * @return true when the framebuffer is ready.
+		 */
+		bool open_shared_framebuffer();
+
+		/**
+		 * @brief Gets the doorbell of the shared framebuffer so it can be watched by the event loop.
+		 * @return eventfd rung by clients, or -1 without a shared framebuffer.
+		 */
+		int shared_framebuffer_fd() const;
+
+		/**
+		 * @brief Pushes the newest frame of the shared framebuffer to the LCD. Called when its doorbell rings.
+		 */
+		void show_shared_frame();
+
 		/**
 		 * @brief Reads and applies a device configuration file.
 		 * @param filename configuration file path.
@@ -154,10 +229,41 @@ namespace G13 {
 		void read_config_file(const std::string& filename);
 
 		/**
-		 * @brief Reads one key report from the device.
-		 * @return libusb submission or read status code.
+		 * @brief Starts the key endpoint of the backend. Reports are handled by handle_report, losing the device signals lost_fd.
+		 * @param transfer_count number of transfers kept in flight at once.
+		 * @return 0 on success, -1 when the transfers could not be submitted.
+		 */
+		int read_keys(size_t transfer_count = G13_KEY_TRANSFERS);
+
+		/**
+		 * @brief Handles a key report delivered by the key endpoint: records it if asked to, then processes it.
+		 * @param buffer raw G13_REPORT_SIZE byte report.
+		 * @param time time the report arrived.
+		 * @param received monotonic time the report arrived.
 		 */
-		int read_keys();
+		void handle_report(unsigned char* buffer, const timeval& time, G13_LatencyClock::time_point received);
+
+		/**
+		 * @brief Appends every completed key report to a report log from now on.
+		 * @param filename path of the log, it is truncated.
+		 * @return true when the log was opened.
+		 */
+		bool record_reports(const std::string& filename);
+
+		/**
+		 * @brief Parses one raw key report and emits the resulting input events with a single write.
+		 * Adds the report's latencies to latency().
+		 * @param buffer raw G13_REPORT_SIZE byte report.
+		 * @param time timestamp shared by all events of the report.
+		 * @param received monotonic time the report arrived, the start of its latency.
+		 */
+		void process_report(unsigned char* buffer, const timeval& time, G13_LatencyClock::time_point received);
+
+		/**
+		 * @brief Gets the latency histograms of the key reports.
+		 * @return latency statistics.
+		 */
+		G13_LatencyStats& latency() { return _latency; }
 
 		/**
 		 * @brief Parses joystick state from a raw G13 key report.
@@ -165,6 +271,92 @@ namespace G13 {
 		 */
 		void parse_joystick(unsigned char* buf);
 
+		/**
+		 * @brief Runs an action for a key or stick zone edge.
+		 *
+		 * On the input thread only realtime actions run immediately, everything else is
+		 * handed to the worker through a lock-free queue and executed by run_deferred.
+		 * @param action action to run, may be nullptr.
+		 * @param is_down true for a press, false for a release.
+		 */
+		void dispatch(const G13_ActionPtr& action, bool is_down);
+
+		/**
+		 * @brief Starts a dedicated thread that handles this device's USB events and key reports.
+		 *
+		 * The backend's libusb context must not be shared with any other device or event loop.
+		 * @param rt_priority SCHED_FIFO priority for the thread, or 0 to keep the default scheduler.
+		 * @return true when the thread was started.
+		 */
+		bool start_input_thread(int rt_priority);
+
+		/**
+		 * @brief Stops and joins the input thread if it is running.
+		 */
+		void stop_input_thread();
+
+		/**
+		 * @brief Tells whether the device handles its input on a dedicated thread.
+		 * @return true while the input thread is running.
+		 */
+		bool input_thread_running() const { return _input_thread.joinable(); }
+
+		/**
+		 * @brief Gets the eventfd signalled when the input thread queued deferred actions.
+		 * @return eventfd descriptor, or -1 when no input thread is running.
+		 */
+		int deferred_fd() const { return _deferred_fd; }
+
+		/**
+		 * @brief Gets the eventfd signalled when the key endpoint lost the device.
+		 * @return eventfd descriptor, or -1 before read_keys.
+		 */
+		int lost_fd() const { return _lost_fd; }
+
+		/**
+		 * @brief Runs actions deferred by the input thread. Called by the worker when deferred_fd is readable.
+		 */
+		void run_deferred();
+
+		/**
+		 * @brief Runs a function while the input thread is parked, so it may change profiles, bindings and stick state.
+		 * @param fn function to run.
+		 */
+		void with_input_paused(const std::function<void()>& fn);
+
+		/**
+		 * @brief Registers the timerfd driving the device's timer wheel with the loop that handles its input.
+		 * @param loop the input thread's loop, or the manager's loop when the device has no input thread.
+		 * @return true when the timer was created.
+		 */
+		bool attach_timers(G13_EventLoop& loop);
+
+		/**
+		 * @brief Schedules a callback on the device's timer wheel. Callbacks run where key reports are
+		 * processed and their input events are written with one write. Only call from the input
+		 * side: a key report, a timer callback, or while the input thread is paused.
+		 * @param delay time until the callback runs.
+		 * @param callback function to run.
+		 * @param interval period after which the callback runs again; zero runs it once.
+		 * @return id for cancel_timer.
+		 */
+		G13_TimerWheel::TimerId schedule_timer(std::chrono::milliseconds delay, G13_TimerWheel::TIMER_CALLBACK callback,
+											   std::chrono::milliseconds interval = std::chrono::milliseconds::zero());
+
+		/**
+		 * @brief Schedules a callback to run once at a given time, see schedule_timer.
+		 * @param when time the callback should run at, rounded up to the next millisecond.
+		 * @param callback function to run.
+		 * @return id for cancel_timer.
+		 */
+		G13_TimerWheel::TimerId schedule_timer_at(G13_TimerWheel::Clock::time_point when, G13_TimerWheel::TIMER_CALLBACK callback);
+
+		/**
+		 * @brief Cancels a timer scheduled with schedule_timer.
+		 * @param id timer to cancel; G13_TimerWheel::NO_TIMER is ignored.
+		 */
+		void cancel_timer(G13_TimerWheel::TimerId id);
+
 		/**
 		 * @brief Creates an action object from a textual action description.
 		 * @param action textual action description.
@@ -187,13 +379,50 @@ namespace G13 {
 		void set_mode_leds(int leds);
 
 		/**
-		 * @brief Sends one Linux input event through uinput.
+		 * @brief Gets the binding layer selected with the M-keys.
+		 * @return 0 for M1 up to G13_NUM_LAYERS - 1 for M3.
+		 */
+		int layer() const { return _layer; }
+
+		/**
+		 * @brief Selects the binding layer used by the next key press and lights its mode LED.
+		 * The LED is written by the worker thread, the control transfer would stall the input thread.
+		 * @param layer 0 for M1 up to G13_NUM_LAYERS - 1 for M3.
+		 */
+		void set_layer(int layer);
+
+		/**
+		 * @brief Sends one Linux input event to the event sink. While a report is processed the event is
+		 * staged and written together with the rest of the report.
 		 * @param type input event type.
 		 * @param code input event code.
 		 * @param val input event value.
 		 */
 		void send_event(int type, int code, int val);
 
+		/**
+		 * @brief Writes all staged input events to the event sink with one write.
+		 */
+		void flush_events();
+
+		/**
+		 * @brief Starts staging input events, all of them carry the given timestamp.
+		 * @param time timestamp for the staged events.
+		 */
+		void begin_events(const timeval& time);
+
+		/**
+		 * @brief Ends the current input frame with a SYN_REPORT, events sent after it form a new frame.
+		 * A key pressed and released again has to span two frames, consumers sampling per frame miss it otherwise.
+		 */
+		void sync_events();
+
+		/**
+		 * @brief Terminates the staged events with a SYN_REPORT and writes them.
+		 * @return true when events were staged since begin_events.
+		 */
+		bool end_events();
+
 		/**
 		 * @brief Writes text to the device output FIFO.
 		 * @param out text to write.
@@ -201,7 +430,7 @@ namespace G13 {
 		void write_output_pipe(const std::string& out);
 
 		/**
-		 * @brief Writes an LCD framebuffer to the hardware.
+		 * @brief Queues an LCD framebuffer on the LCD endpoint without blocking.
 		 * @param data LCD data buffer.
 		 * @param size number of bytes to write.
 		 */
@@ -212,7 +441,7 @@ namespace G13 {
 		 * @param key key index to inspect.
 		 * @return true when the key is pressed.
 		 */
-		bool is_set(int key);
+		bool is_set(int key) const { return _key_state >> key & 1; }
 
 		/**
 		 * @brief Updates cached key state.
@@ -222,12 +451,34 @@ namespace G13 {
 		 */
 		bool update(int key, bool v);
 
+		/**
+		 * @brief Replaces the cached state of all keys at once.
+		 * @param state pressed keys, bit N set for key index N.
+		 * @return bits of the keys whose state changed.
+		 */
+		uint64_t update_keys(uint64_t state);
+
+		/**
+		 * @brief Gets the action that received the press of a key, it also receives the release.
+		 * Kept by the device so a release reaches it even after a profile or layer switch.
+		 * @param index key index.
+		 * @return slot holding the action, empty while the key is up.
+		 */
+		G13_ActionPtr& pressed_action(int index) { return _pressed_actions[index]; }
+
 		// used by G13_Manager
 		/**
-		 * @brief Closes device file descriptors and releases libusb resources.
+		 * @brief Stops the transports, closes device file descriptors and releases the backend's hardware.
 		 */
 		void cleanup();
 
+		/**
+		 * @brief Builds the control socket path for this device.
+		 * @param manager manager that owns the runtime directory.
+		 * @return socket path, or an empty string when the socket is disabled.
+		 */
+		std::string make_socket_name(G13_Manager& manager);
+
 		/**
 		 * @brief Builds a FIFO path for this device.
 		 * @param manager manager that owns the runtime pipe directory.
@@ -237,11 +488,10 @@ namespace G13 {
 		std::string make_pipe_name(G13_Manager& manager, bool is_input);
 
 		/**
-		 * @brief Registers the libusb context and creates manager-owned FIFOs.
-		 * @param ctx libusb context used by this device.
+		 * @brief Initializes LCD and LEDs, opens the event sink and creates manager-owned FIFOs.
 		 * @param manager manager that owns runtime paths.
 		 */
-		void register_context(libusb_context* ctx, G13_Manager& manager);
+		void open_transports(G13_Manager& manager);
 
 		/**
 		 * @brief Writes an image file to the LCD.
@@ -288,16 +538,28 @@ namespace G13 {
 		typedef std::map<std::string, COMMAND_FUNCTION> CommandFunctionTable;
 
 		/**
-		 * @brief Converts a libusb error code to a human-readable string.
-		 * @param code libusb status or error code.
-		 * @return human-readable libusb result text.
+		 * @brief Displays the currently active app on the LCD screen and schedules its next redraw
 		 */
-		std::string describe_libusb_error_code(int code);
+		void display_app();
 
 		/**
-		 * @brief Displays the currently active app on the LCD screen
+		 * @brief Sets the timer that drives display_app. The display is only redrawn when the timer fires.
+		 * @param timer_fd timerfd created by the manager's event loop
+		 * @param max_fps upper bound for redraws per second
 		 */
-		void display_app();
+		void set_display_timer(int timer_fd, int max_fps);
+
+		/**
+		 * @brief Limits how often the display is redrawn.
+		 * @param max_fps upper bound for redraws per second
+		 */
+		void set_max_fps(int max_fps);
+
+		/**
+		 * @brief Asks for the active app to be redrawn as soon as the frame rate limit allows.
+		 * Safe to call from the input thread.
+		 */
+		void request_redraw();
 
 		/**
 		 * @brief Gets the index of the currently displayed app
@@ -311,11 +573,6 @@ namespace G13 {
 		void next_app();
 
 	protected:
-		/**
-		 * @brief Initializes the LCD subsystem.
-		 */
-		void init_lcd();
-
 		/**
 		 * @brief Registers built-in text commands.
 		 */
@@ -326,20 +583,44 @@ namespace G13 {
 		 */
 		void _init_apps();
 
+		/**
+		 * @brief Arms the display timer for the given time, delayed to respect the frame rate limit.
+		 * @param when earliest time the display should be redrawn
+		 */
+		void schedule_display(std::chrono::steady_clock::time_point when);
+
 		CommandFunctionTable _command_table;
 
-		struct input_event _event {};
+		// Input events of the report being processed, written at once by flush_events
+		struct input_event _events[G13_EVENT_BATCH_SIZE] {};
+		size_t _event_count = 0;
+		bool _batching_events = false;
+		bool _batch_has_events = false;
+		// a frame of the batch was already ended by sync_events
+		bool _batch_synced = false;
+		timeval _batch_time {};
 
 		unsigned long _id_within_manager;
-		libusb_device_handle* handle;
-		libusb_context* ctx;
+		std::unique_ptr<G13_Backend> _backend;
 
-		int _uinput_fid;
+		// declared before every member holding actions, an action destroyed along with the device
+		// may still cancel its timer
+		G13_TimerWheel _timers;
+		int _timer_fd = -1;
 
 		int _input_pipe_fid;
 		std::string _input_pipe_name;
+		// reassembles commands and LCD frames from the input FIFO
+		G13_InputDecoder _input_decoder;
+		// a 960 byte read of the input pipe is an unframed LCD image, for writers predating frames
+		bool _raw_lcd_images = false;
 		int _output_pipe_fid;
 		std::string _output_pipe_name;
+		// collects what write_output_pipe writes while execute runs a command
+		std::string* _command_output = nullptr;
+		// descriptors the command run by execute passes to its client
+		std::vector<int>* _command_fds = nullptr;
+		std::unique_ptr<G13_SharedFramebuffer> _shared_framebuffer;
 
 		std::map<std::string, ProfilePtr> _profiles;
 		ProfilePtr _current_profile;
@@ -347,12 +628,18 @@ namespace G13 {
 		std::shared_ptr<G13_Log> _logger;
 		G13_LCD _lcd;
 		std::shared_ptr<G13_Stick> _stick;
+		std::shared_ptr<G13_MacroPlayer> _macros;
+		std::shared_ptr<G13_KeyBindingState> _key_bindings;
+		std::shared_ptr<G13_ReportRecorder> _recorder;
+		G13_LatencyStats _latency;
 		std::string _profiles_dir;
 
-		bool keys[G13_NUM_KEYS];
-
-		unsigned char* key_buffer;
-		libusb_transfer* transfer;
+		// bit N is set while key index N is pressed
+		uint64_t _key_state = 0;
+		// action that received the press of each key
+		std::array<G13_ActionPtr, G13_NUM_KEYS> _pressed_actions;
+		int _layer = 0;
+		G13_ActionPtr _layer_leds_action;
 
 		/**
 		 * @brief Tracks the index of the currently active DisplayApp
@@ -363,12 +650,55 @@ namespace G13 {
 		 * @brief Stores the list of available DisplayApps
 		 */
 		std::vector<std::shared_ptr<G13_DisplayApp>> _apps;
+
+		// set once before the input thread starts, which only reads it
+		int _display_timer_fd = -1;
+		std::atomic<std::chrono::steady_clock::duration::rep> _min_frame_interval{0};
+		std::atomic<std::chrono::steady_clock::duration::rep> _last_render{0};
+		std::atomic<bool> _redraw_requested{false};
+		// Set while the active app shows the stick position
+		std::atomic<bool> _redraw_on_stick{false};
+		uint16_t _last_stick_report = 0;
+
+		struct DeferredAction {
+			G13_ActionPtr action;
+			bool is_down = false;
+		};
+
+		std::thread _input_thread;
+		// set by the input thread itself, _input_thread may still be being assigned when it handles its first transfer
+		std::atomic<std::thread::id> _input_thread_id{};
+		std::unique_ptr<G13_EventLoop> _input_loop;
+		int _input_wake_fd = -1;
+		int _deferred_fd = -1;
+		int _lost_fd = -1;
+		int _pause_depth = 0;
+		std::atomic<bool> _input_stop{false};
+		std::atomic<bool> _input_pause_requested{false};
+		std::atomic<bool> _input_paused{false};
+		G13_SpscQueue<DeferredAction, G13_DEFERRED_QUEUE_SIZE> _deferred;
+
 	private:
 		/**
-		 * @brief Creates and configures the uinput device.
-		 * @return file descriptor for the uinput device, or a negative value on failure.
+		 * @brief Runs the due timers of the wheel and re-arms the timerfd for the next one.
+		 */
+		void run_timers();
+
+		/**
+		 * @brief Arms the timerfd for the earliest timer on the wheel, or disarms it.
+		 */
+		void arm_timers();
+
+		/**
+		 * @brief Body of the input thread: handles USB events until stopped, parking when the worker asks.
+		 */
+		void input_thread_main();
+
+		/**
+		 * @brief Tells whether the caller runs on this device's input thread.
+		 * @return true on the input thread.
 		 */
-		int g13_create_uinput();
+		bool on_input_thread() const { return std::this_thread::get_id() == _input_thread_id.load(std::memory_order_acquire); }
 
 		/**
 		 * @brief Creates a FIFO if needed and opens it.
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "g13_event_loop.h"
+#include "g13_log.h"
+
+namespace G13 {
+	G13_EventLoop::G13_EventLoop(std::shared_ptr<G13_Log> logger) : _logger(std::move(logger)) {
+		_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (_epoll_fd == -1) {
+			_logger->error(std::string("Failed creating epoll instance: ") + std::strerror(errno));
+		}
+	}
+
+	G13_EventLoop::~G13_EventLoop() {
+		while (!_usb_watches.empty()) {
+			unwatch_usb(_usb_watches.back()->ctx);
+		}
+		for (const int fd : _timers) {
+			close(fd);
+		}
+		if (_epoll_fd != -1) {
+			close(_epoll_fd);
+		}
+	}
+
+	bool G13_EventLoop::add_fd(int fd, uint32_t events, FD_HANDLER handler) {
+		epoll_event event{};
+		event.events = events;
+		event.data.fd = fd;
+		if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+			_logger->error("Failed watching fd " + std::to_string(fd) + ": " + std::strerror(errno));
+			return false;
+		}
+		_handlers[fd] = std::make_shared<FD_HANDLER>(std::move(handler));
+		return true;
+	}
+
+	bool G13_EventLoop::modify_fd(int fd, uint32_t events) {
+		epoll_event event{};
+		event.events = events;
+		event.data.fd = fd;
+		if (epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1) {
+			_logger->error("Failed changing events of fd " + std::to_string(fd) + ": " + std::strerror(errno));
+			return false;
+		}
+		return true;
+	}
+
+	void G13_EventLoop::remove_fd(int fd) {
+		if (_handlers.erase(fd)) {
+			epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+		}
+	}
+
+	int G13_EventLoop::add_timer(TIMER_HANDLER handler) {
+		const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (fd == -1) {
+			_logger->error(std::string("Failed creating timer: ") + std::strerror(errno));
+			return -1;
+		}
+
+		const bool added = add_fd(fd, EPOLLIN, [fd, handler = std::move(handler)](uint32_t) {
+			uint64_t expirations;
+			if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+				handler();
+			}
+		});
+		if (!added) {
+			close(fd);
+			return -1;
+		}
+
+		_timers.push_back(fd);
+		return fd;
+	}
+
+	void G13_EventLoop::arm_timer(int fd, std::chrono::nanoseconds initial, std::chrono::nanoseconds interval) {
+		using namespace std::chrono;
+		itimerspec spec{};
+		spec.it_value.tv_sec = duration_cast<seconds>(initial).count();
+		spec.it_value.tv_nsec = (initial % seconds(1)).count();
+		spec.it_interval.tv_sec = duration_cast<seconds>(interval).count();
+		spec.it_interval.tv_nsec = (interval % seconds(1)).count();
+		timerfd_settime(fd, 0, &spec, nullptr);
+	}
+
+	void G13_EventLoop::remove_timer(int fd) {
+		remove_fd(fd);
+		if (const auto found = std::ranges::find(_timers, fd); found != _timers.end()) {
+			_timers.erase(found);
+			close(fd);
+		}
+	}
+
+	void G13_EventLoop::watch_usb(libusb_context* ctx) {
+		auto& watch = _usb_watches.emplace_back(std::make_unique<UsbWatch>(UsbWatch{this, ctx}));
+
+		const libusb_pollfd** pollfds = libusb_get_pollfds(ctx);
+		if (pollfds != nullptr) {
+			for (const libusb_pollfd** pollfd = pollfds; *pollfd != nullptr; pollfd++) {
+				usb_pollfd_added((*pollfd)->fd, (*pollfd)->events, watch.get());
+			}
+			libusb_free_pollfds(pollfds);
+		}
+		libusb_set_pollfd_notifiers(ctx, usb_pollfd_added, usb_pollfd_removed, watch.get());
+	}
+
+	void G13_EventLoop::unwatch_usb(libusb_context* ctx) {
+		const auto found = std::ranges::find_if(_usb_watches, [ctx](const auto& watch) { return watch->ctx == ctx; });
+		if (found == _usb_watches.end()) {
+			return;
+		}
+
+		libusb_set_pollfd_notifiers(ctx, nullptr, nullptr, nullptr);
+		const libusb_pollfd** pollfds = libusb_get_pollfds(ctx);
+		if (pollfds != nullptr) {
+			for (const libusb_pollfd** pollfd = pollfds; *pollfd != nullptr; pollfd++) {
+				remove_fd((*pollfd)->fd);
+			}
+			libusb_free_pollfds(pollfds);
+		}
+		_usb_watches.erase(found);
+	}
+
+	void G13_EventLoop::usb_pollfd_added(int fd, short events, void* user_data) {
+		auto* watch = static_cast<UsbWatch*>(user_data);
+		libusb_context* ctx = watch->ctx;
+		G13_EventLoop* loop = watch->loop;
+		// poll() and epoll share the values of the IN/OUT flags
+		loop->add_fd(fd, static_cast<uint16_t>(events), [loop, ctx](uint32_t) {
+			loop->handle_usb(ctx);
+		});
+	}
+
+	void G13_EventLoop::usb_pollfd_removed(int fd, void* user_data) {
+		static_cast<UsbWatch*>(user_data)->loop->remove_fd(fd);
+	}
+
+	void G13_EventLoop::handle_usb(libusb_context* ctx) {
+		timeval zero{0, 0};
+		const int error = libusb_handle_events_timeout_completed(ctx, &zero, nullptr);
+		if (error != LIBUSB_SUCCESS && error != LIBUSB_ERROR_INTERRUPTED) {
+			_logger->error("Error while handling usb events: " + std::to_string(error));
+			_usb_failed = true;
+		}
+	}
+
+	int G13_EventLoop::usb_timeout(int timeout_ms) {
+		for (const auto& watch : _usb_watches) {
+			// Linux libusb drives its own timeouts through a timerfd in the pollfd set
+			if (libusb_pollfds_handle_timeouts(watch->ctx)) {
+				continue;
+			}
+			timeval next{};
+			if (libusb_get_next_timeout(watch->ctx, &next) == 1) {
+				const int next_ms = static_cast<int>(next.tv_sec * 1000 + (next.tv_usec + 999) / 1000);
+				timeout_ms = timeout_ms < 0 ? next_ms : std::min(timeout_ms, next_ms);
+			}
+		}
+		return timeout_ms;
+	}
+
+	int G13_EventLoop::run_once(int timeout_ms) {
+		epoll_event events[32];
+		const int count = epoll_wait(_epoll_fd, events, 32, usb_timeout(timeout_ms));
+		if (count == -1) {
+			if (errno == EINTR) {
+				return 0;
+			}
+			_logger->error(std::string("epoll_wait failed: ") + std::strerror(errno));
+			return -1;
+		}
+
+		if (count == 0) {
+			for (const auto& watch : _usb_watches) {
+				if (!libusb_pollfds_handle_timeouts(watch->ctx)) {
+					handle_usb(watch->ctx);
+				}
+			}
+		}
+
+		for (int i = 0; i < count; i++) {
+			// Look the handler up again, an earlier handler may have removed it
+			const auto found = _handlers.find(events[i].data.fd);
+			if (found == _handlers.end()) {
+				continue;
+			}
+			// Keep the handler alive even if it removes itself
+			const std::shared_ptr<FD_HANDLER> handler = found->second;
+			(*handler)(events[i].events);
+		}
+
+		return count;
+	}
+}
@@ -0,0 +1,141 @@
+#ifndef G13_G13_EVENT_LOOP_H
+#define G13_G13_EVENT_LOOP_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <libusb-1.0/libusb.h>
+
+namespace G13 {
+	class G13_Log;
+
+	/**
+	 * @brief epoll based reactor that sleeps until a watched file descriptor is ready.
+	 *
+	 * The loop watches libusb's pollfds (tracked through the pollfd notifiers), plain
+	 * file descriptors such as the command FIFOs, and timerfds used for periodic work.
+	 */
+	class G13_EventLoop {
+	public:
+		typedef std::function<void(uint32_t events)> FD_HANDLER;
+		typedef std::function<void()> TIMER_HANDLER;
+
+		/**
+		 * @brief Creates the epoll instance.
+		 * @param logger logger used for loop diagnostics.
+		 */
+		explicit G13_EventLoop(std::shared_ptr<G13_Log> logger);
+
+		/**
+		 * @brief Stops watching all libusb contexts and closes owned descriptors.
+		 */
+		~G13_EventLoop();
+
+		G13_EventLoop(const G13_EventLoop&) = delete;
+		G13_EventLoop& operator=(const G13_EventLoop&) = delete;
+
+		/**
+		 * @brief Starts watching a file descriptor.
+		 * @param fd descriptor to watch.
+		 * @param events epoll event mask, e.g. EPOLLIN.
+		 * @param handler called with the ready events whenever the descriptor is ready.
+		 * @return true when the descriptor was added.
+		 */
+		bool add_fd(int fd, uint32_t events, FD_HANDLER handler);
+
+		/**
+		 * @brief Changes the events a watched descriptor is reported for, keeping its handler.
+		 * @param fd watched descriptor.
+		 * @param events new epoll event mask.
+		 * @return true when the mask was changed.
+		 */
+		bool modify_fd(int fd, uint32_t events);
+
+		/**
+		 * @brief Stops watching a file descriptor. The descriptor is not closed.
+		 * @param fd descriptor to remove.
+		 */
+		void remove_fd(int fd);
+
+		/**
+		 * @brief Creates a monotonic timerfd owned by the loop. The timer starts disarmed.
+		 * @param handler called once per wakeup, after the expiration count has been read.
+		 * @return timerfd descriptor, or -1 on failure.
+		 */
+		int add_timer(TIMER_HANDLER handler);
+
+		/**
+		 * @brief Arms or disarms a timer created by add_timer.
+		 * @param fd timerfd descriptor.
+		 * @param initial delay until the first expiration; zero disarms the timer.
+		 * @param interval period for subsequent expirations; zero makes the timer one-shot.
+		 */
+		static void arm_timer(int fd, std::chrono::nanoseconds initial, std::chrono::nanoseconds interval = std::chrono::nanoseconds::zero());
+
+		/**
+		 * @brief Removes and closes a timer created by add_timer.
+		 * @param fd timerfd descriptor.
+		 */
+		void remove_timer(int fd);
+
+		/**
+		 * @brief Watches all pollfds of a libusb context and handles its events when they become ready.
+		 * @param ctx libusb context to watch.
+		 */
+		void watch_usb(libusb_context* ctx);
+
+		/**
+		 * @brief Stops watching a libusb context.
+		 * @param ctx libusb context previously passed to watch_usb.
+		 */
+		void unwatch_usb(libusb_context* ctx);
+
+		/**
+		 * @brief Waits for at least one ready descriptor and dispatches its handler.
+		 * @param timeout_ms maximum time to sleep; -1 sleeps until something is ready.
+		 * @return number of dispatched events, 0 on timeout or signal, or -1 on a fatal error.
+		 */
+		int run_once(int timeout_ms = -1);
+
+		/**
+		 * @brief Tells whether any watched libusb context reported an unrecoverable error.
+		 * @return true after libusb event handling failed.
+		 */
+		bool usb_failed() const { return _usb_failed; }
+
+	private:
+		/**
+		 * @brief Processes pending libusb events without blocking.
+		 * @param ctx libusb context to service.
+		 */
+		void handle_usb(libusb_context* ctx);
+
+		/**
+		 * @brief Computes how long epoll may sleep before libusb needs to handle a timeout.
+		 * @param timeout_ms caller supplied timeout.
+		 * @return timeout to pass to epoll_wait.
+		 */
+		int usb_timeout(int timeout_ms);
+
+		static void usb_pollfd_added(int fd, short events, void* user_data);
+		static void usb_pollfd_removed(int fd, void* user_data);
+
+		struct UsbWatch {
+			G13_EventLoop* loop;
+			libusb_context* ctx;
+		};
+
+		std::shared_ptr<G13_Log> _logger;
+		int _epoll_fd;
+		bool _usb_failed = false;
+		std::map<int, std::shared_ptr<FD_HANDLER>> _handlers;
+		std::vector<int> _timers;
+		std::vector<std::unique_ptr<UsbWatch>> _usb_watches;
+	};
+}
+
+#endif //G13_G13_EVENT_LOOP_H
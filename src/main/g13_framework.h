@@ -0,0 +1,9 @@
+#ifndef G13_G13_FRAMEWORK_H
+#define G13_G13_FRAMEWORK_H
+
+/**
+ * @brief Loads all necessary class factories into the IoC container
+ */
+void bootFramework();
+
+#endif //G13_G13_FRAMEWORK_H
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstring>
+
+#include "g13_device.h"
+#include "g13_input_decoder.h"
+
+namespace G13 {
+	std::span<unsigned char> G13_InputDecoder::space() {
+		if (_start == _end) {
+			_start = _end = 0;
+		} else if (G13_INPUT_BUFFER_SIZE - _end < G13_INPUT_HEADER_SIZE + G13_INPUT_MAX_PAYLOAD) {
+			// Only an incomplete message is left, usually a few bytes
+			memmove(_buffer.get(), _buffer.get() + _start, _end - _start);
+			_end -= _start;
+			_start = 0;
+		}
+		return {_buffer.get() + _end, G13_INPUT_BUFFER_SIZE - _end};
+	}
+
+	bool G13_InputDecoder::next(G13_InputMessage& message) {
+		while (true) {
+			if (_commands_left > 0) {
+				next_frame_command(message);
+				return true;
+			}
+
+			const size_t available = _end - _start;
+			if (available == 0) {
+				return false;
+			}
+			unsigned char* data = _buffer.get() + _start;
+
+			if (data[0] == G13_INPUT_MAGIC[0]) {
+				// Text never contains a NUL, so this is a frame or garbage
+				if (memcmp(data, G13_INPUT_MAGIC, std::min(available, sizeof(G13_INPUT_MAGIC))) != 0) {
+					skip_garbage();
+					continue;
+				}
+				if (available < G13_INPUT_HEADER_SIZE) {
+					return false;
+				}
+				const unsigned char type = data[4];
+				const unsigned char reserved = data[5];
+				const size_t length = data[6] | data[7] << 8;
+				if (available < G13_INPUT_HEADER_SIZE + length) {
+					return false;
+				}
+
+				_start += G13_INPUT_HEADER_SIZE;
+				_stats.frames++;
+				if (reserved == 0 && type == G13_INPUT_COMMANDS) {
+					_commands_left = length;
+					continue;
+				}
+				if (reserved == 0 && type == G13_INPUT_LCD && length == G13_LCD_BUFFER_SIZE) {
+					message.type = G13_INPUT_LCD;
+					message.data = data + G13_INPUT_HEADER_SIZE;
+					message.size = length;
+					_start += length;
+					return true;
+				}
+				// The length is still trusted, so the stream stays in sync
+				_stats.errors++;
+				_start += length;
+				continue;
+			}
+
+			// Unframed text, a line ends at a newline or where a frame starts
+			char* line = reinterpret_cast<char*>(data);
+			char* end = line + available;
+			char* line_end = std::find_if(line, end, [](char c) {
+				return c == '\n' || c == static_cast<char>(G13_INPUT_MAGIC[0]);
+			});
+			if (line_end == end) {
+				if (_resyncing || available > G13_INPUT_MAX_LINE) {
+					// Too long to be a command, the rest of it is dropped as well
+					_stats.errors += _resyncing ? 0 : 1;
+					_resyncing = true;
+					_start = _end;
+				}
+				return false;
+			}
+
+			// The NUL starting a frame already terminates the line
+			_start += line_end - line + (*line_end == '\n' ? 1 : 0);
+			if (_resyncing) {
+				_resyncing = false;
+				continue;
+			}
+			message.type = G13_INPUT_COMMANDS;
+			message.command = terminate(line, line_end, *line_end == '\n');
+			_stats.commands++;
+			return true;
+		}
+	}
+
+	void G13_InputDecoder::next_frame_command(G13_InputMessage& message) {
+		char* line = reinterpret_cast<char*>(_buffer.get() + _start);
+		char* end = line + _commands_left;
+		char* line_end = std::find(line, end, '\n');
+
+		// The last line of a frame needs no newline
+		const size_t used = line_end - line + (line_end == end ? 0 : 1);
+		_start += used;
+		_commands_left -= used;
+
+		message.type = G13_INPUT_COMMANDS;
+		message.command = terminate(line, line_end, line_end != end);
+		_stats.commands++;
+	}
+
+	std::string_view G13_InputDecoder::terminate(char* line, char* end, bool writable) {
+		char* comment = std::find(line, end, '#');
+		if (comment != end || writable) {
+			*comment = 0;
+			return {line, comment};
+		}
+		if (end < reinterpret_cast<char*>(_buffer.get() + _end) && *end == 0) {
+			return {line, end};
+		}
+		_last_line.assign(line, end);
+		return _last_line;
+	}
+
+	void G13_InputDecoder::skip_garbage() {
+		_stats.errors++;
+		// The rest of the broken frame is dropped up to the next frame or line
+		_start++;
+		_resyncing = true;
+	}
+}
@@ -0,0 +1,122 @@
+#ifndef G13_G13_INPUT_DECODER_H
+#define G13_G13_INPUT_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace G13 {
+	/*
+	 * A frame on the input pipe is an 8 byte header followed by its payload:
+	 *   4 bytes  magic "\0G13"
+	 *   1 byte   type, G13_INPUT_COMMANDS or G13_INPUT_LCD
+	 *   1 byte   reserved, 0
+	 *   2 bytes  payload length, little endian
+	 * Text written without a header is read as newline separated commands, as always.
+	 */
+	const unsigned char G13_INPUT_MAGIC[4] = {0x00, 'G', '1', '3'};
+	const size_t G13_INPUT_HEADER_SIZE = 8;
+	const size_t G13_INPUT_MAX_PAYLOAD = 0xffff;
+	// Unframed text longer than this without a newline is dropped
+	const size_t G13_INPUT_MAX_LINE = 64 * 1024;
+	// Holds one incomplete frame or line and room to read the rest
+	const size_t G13_INPUT_BUFFER_SIZE = 2 * (G13_INPUT_HEADER_SIZE + G13_INPUT_MAX_PAYLOAD);
+
+	enum G13_InputType : uint8_t {
+		// newline separated commands
+		G13_INPUT_COMMANDS = 1,
+		// one G13_LCD_BUFFER_SIZE byte LCD image
+		G13_INPUT_LCD = 2
+	};
+
+	/*!
+	 * One decoded message: a single command or an LCD image. Both point into the decoder's
+	 * buffer and are valid until its next() or space() is called again.
+	 */
+	struct G13_InputMessage {
+		G13_InputType type = G13_INPUT_COMMANDS;
+		// the command without its newline and comment, followed by a NUL
+		std::string_view command;
+		// the LCD image
+		unsigned char* data = nullptr;
+		size_t size = 0;
+	};
+
+	/*!
+	 * splits the byte stream of the input pipe into commands and LCD images
+	 *
+	 * The pipe is read straight into the decoder's buffer, however the writer split or merged
+	 * its writes. Incomplete lines and frames wait for the rest, malformed frames are skipped
+	 * up to the next line or frame. Undecoded bytes are moved to the front of the buffer when
+	 * its end is near, so every line and frame stays contiguous.
+	 */
+	class G13_InputDecoder {
+	public:
+		G13_InputDecoder() : _buffer(std::make_unique_for_overwrite<unsigned char[]>(G13_INPUT_BUFFER_SIZE)) {}
+
+		/*!
+		 * free space to read into, the bytes read are added with commit
+		 */
+		std::span<unsigned char> space();
+
+		/*!
+		 * adds bytes read into space()
+		 */
+		void commit(size_t size) { _end += size; }
+
+		/*!
+		 * takes the next complete message
+		 * @return false when the buffered bytes hold no complete message
+		 */
+		bool next(G13_InputMessage& message);
+
+		/*!
+		 * tells whether no partial message is buffered
+		 */
+		bool empty() const { return _start == _end && _commands_left == 0; }
+
+		struct Stats {
+			uint64_t frames = 0;
+			uint64_t commands = 0;
+			uint64_t errors = 0;
+		};
+		const Stats& stats() const { return _stats; }
+
+	private:
+		/*!
+		 * takes the next line of the command frame being read
+		 */
+		void next_frame_command(G13_InputMessage& message);
+
+		/*!
+		 * cuts the comment off a line and ends it with a NUL
+		 * @param line first byte of the line
+		 * @param end byte after the line
+		 * @param writable tells whether end may be overwritten, it may start the next message
+		 */
+		std::string_view terminate(char* line, char* end, bool writable);
+
+		/*!
+		 * drops a malformed frame start so decoding continues after it
+		 */
+		void skip_garbage();
+
+		std::unique_ptr<unsigned char[]> _buffer;
+		// first byte not decoded yet
+		size_t _start = 0;
+		// end of the bytes read
+		size_t _end = 0;
+		// bytes of a command frame's payload still to be split into lines, starting at _start
+		size_t _commands_left = 0;
+		// set after a malformed frame start or an overlong line, until the next line or frame
+		bool _resyncing = false;
+		// the last line of a command frame, when the byte after it cannot be overwritten
+		std::string _last_line;
+		Stats _stats;
+	};
+}
+
+#endif //G13_G13_INPUT_DECODER_H
@@ -0,0 +1,157 @@
+#include <bit>
+
+#include "g13_device.h"
+#include "g13_key_bindings.h"
+#include "g13_keys.h"
+#include "g13_log.h"
+
+namespace G13 {
+	void G13_KeyBindingState::key_changed(G13_KEY_INDEX index, bool is_down) {
+		G13_Profile& profile = _device.current_profile();
+		const uint64_t bit = uint64_t(1) << index;
+
+		if (is_down) {
+			if (profile.chord_mask() & bit) {
+				_phases[index] = KEY_CHORD_PENDING;
+				_pending |= bit;
+				evaluate_chord(false);
+			} else {
+				begin_key(index);
+			}
+			return;
+		}
+
+		switch (_phases[index]) {
+			case KEY_CHORD_PENDING:
+				// Releasing a key ends the chord window, the held back keys become ordinary presses
+				flush_chord();
+				key_changed(index, false);
+				return;
+			case KEY_HOLD_PENDING:
+				// Released in time, tap the layer action
+				_device.cancel_timer(_hold_timers[index]);
+				_hold_timers[index] = G13_TimerWheel::NO_TIMER;
+				profile.press_key(index, _device);
+				// The tap's release gets a frame of its own
+				_device.sync_events();
+				profile.release_key(index, _device);
+				break;
+			case KEY_HOLDING:
+				_device.dispatch(_holding[index], false);
+				_holding[index].reset();
+				break;
+			case KEY_CHORDED:
+				// The first key released releases the chord, the others only finish
+				if (_chord_action && (_chord_keys & bit)) {
+					_device.dispatch(_chord_action, false);
+					_chord_action.reset();
+				}
+				_chord_keys &= ~bit;
+				break;
+			case KEY_PRESSED:
+			case KEY_IDLE:
+				profile.release_key(index, _device);
+				break;
+		}
+		_phases[index] = KEY_IDLE;
+	}
+
+	void G13_KeyBindingState::evaluate_chord(bool expired) {
+		const G13_Profile& profile = _device.current_profile();
+		const uint64_t candidates = profile.chord_candidates(_pending);
+		if (!candidates) {
+			flush_chord();
+			return;
+		}
+
+		int exact = -1;
+		for (uint64_t rest = candidates; rest; rest &= rest - 1) {
+			const int chord = std::countr_zero(rest);
+			if (profile.chord(chord).keys == _pending) {
+				exact = chord;
+				break;
+			}
+		}
+
+		// Wait as long as a larger chord could still be completed
+		if (exact >= 0 && (expired || candidates == uint64_t(1) << exact)) {
+			fire_chord(exact);
+		} else if (expired) {
+			flush_chord();
+		} else if (_chord_timer == G13_TimerWheel::NO_TIMER) {
+			_chord_timer = _device.schedule_timer(_chord_timeout, [this] {
+				_chord_timer = G13_TimerWheel::NO_TIMER;
+				evaluate_chord(true);
+			});
+		}
+	}
+
+	void G13_KeyBindingState::fire_chord(int chord) {
+		_device.cancel_timer(_chord_timer);
+		_chord_timer = G13_TimerWheel::NO_TIMER;
+
+		// A chord still held from before is released first
+		if (_chord_action) {
+			_device.dispatch(_chord_action, false);
+		}
+		_chord_action = _device.current_profile().chord(chord).action;
+		_chord_keys = _pending;
+		for (uint64_t rest = _pending; rest; rest &= rest - 1) {
+			_phases[std::countr_zero(rest)] = KEY_CHORDED;
+		}
+		_pending = 0;
+
+		G13_LOG_DEBUG(_device.logger(), "chord " + std::to_string(chord) + " pressed");
+		_device.dispatch(_chord_action, true);
+	}
+
+	void G13_KeyBindingState::flush_chord() {
+		_device.cancel_timer(_chord_timer);
+		_chord_timer = G13_TimerWheel::NO_TIMER;
+
+		uint64_t keys = _pending;
+		_pending = 0;
+		while (keys) {
+			const int index = std::countr_zero(keys);
+			keys &= keys - 1;
+			begin_key(index);
+		}
+	}
+
+	void G13_KeyBindingState::begin_key(G13_KEY_INDEX index) {
+		G13_Profile& profile = _device.current_profile();
+		const auto& hold = profile.hold(index);
+		if (hold.action) {
+			_phases[index] = KEY_HOLD_PENDING;
+			_hold_timers[index] = _device.schedule_timer(hold.delay, [this, index] {
+				hold_expired(index);
+			});
+		} else {
+			_phases[index] = KEY_PRESSED;
+			profile.press_key(index, _device);
+		}
+	}
+
+	void G13_KeyBindingState::hold_expired(G13_KEY_INDEX index) {
+		_hold_timers[index] = G13_TimerWheel::NO_TIMER;
+		if (_phases[index] != KEY_HOLD_PENDING) {
+			return;
+		}
+		// Never press a key that is already up, its release was the tap
+		if (!_device.is_set(index)) {
+			_phases[index] = KEY_IDLE;
+			return;
+		}
+
+		const auto& hold = _device.current_profile().hold(index);
+		if (!hold.action) {
+			// The binding went away while the key was held
+			_phases[index] = KEY_PRESSED;
+			_device.current_profile().press_key(index, _device);
+			return;
+		}
+		_phases[index] = KEY_HOLDING;
+		_holding[index] = hold.action;
+		_device.dispatch(_holding[index], true);
+	}
+}
@@ -0,0 +1,97 @@
+#ifndef G13_G13_KEY_BINDINGS_H
+#define G13_G13_KEY_BINDINGS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "g13_action.h"
+#include "g13_profile.h"
+#include "g13_timer_wheel.h"
+
+namespace G13 {
+	class G13_Device;
+
+	const std::chrono::milliseconds G13_DEFAULT_CHORD_TIMEOUT(50);
+
+	/*!
+	 * decides what the keys with tap/hold or chord bindings of the current profile do
+	 *
+	 * Only keys in the profile's hold and chord masks, and the releases of keys still in one of
+	 * their phases, pass through here, all other keys go straight to their layer action. A
+	 * chord key is held back until the keys pressed with it either complete a chord or cannot
+	 * be part of one anymore, at the latest when the chord timeout ends. A key with a hold
+	 * binding waits for its hold delay: released before, it taps its layer action, held past
+	 * it, it presses the hold action. Timeouts run on the device timer wheel.
+	 */
+	class G13_KeyBindingState {
+	public:
+		explicit G13_KeyBindingState(G13_Device& device) : _device(device) {}
+
+		/*!
+		 * handles a press or release of a key with a hold or chord binding
+		 */
+		void key_changed(G13_KEY_INDEX index, bool is_down);
+
+		/*!
+		 * tells whether a key is in a tap/hold or chord phase, its release has to come here even
+		 * when the current profile no longer binds it
+		 */
+		bool active(G13_KEY_INDEX index) const { return _phases[index] != KEY_IDLE; }
+
+		/*!
+		 * sets how long chord keys wait for the rest of their chord
+		 */
+		void set_chord_timeout(std::chrono::milliseconds timeout) { _chord_timeout = timeout; }
+		std::chrono::milliseconds chord_timeout() const { return _chord_timeout; }
+
+	private:
+		enum KeyPhase : uint8_t {
+			KEY_IDLE,
+			// held back, waiting for the rest of a chord
+			KEY_CHORD_PENDING,
+			// waiting for the hold delay
+			KEY_HOLD_PENDING,
+			// the hold action is pressed
+			KEY_HOLDING,
+			// the layer action is pressed
+			KEY_PRESSED,
+			// part of a chord that fired
+			KEY_CHORDED
+		};
+
+		/*!
+		 * fires the chord matching the pending keys or gives them up, expired forces a decision
+		 */
+		void evaluate_chord(bool expired);
+		void fire_chord(int chord);
+
+		/*!
+		 * turns the pending chord keys into ordinary presses
+		 */
+		void flush_chord();
+
+		/*!
+		 * starts an ordinary press: waits for the hold delay or presses the layer action
+		 */
+		void begin_key(G13_KEY_INDEX index);
+		void hold_expired(G13_KEY_INDEX index);
+
+		G13_Device& _device;
+		std::chrono::milliseconds _chord_timeout = G13_DEFAULT_CHORD_TIMEOUT;
+
+		std::array<KeyPhase, std::size(G13_KEY_SEQ)> _phases{};
+		std::array<G13_TimerWheel::TimerId, std::size(G13_KEY_SEQ)> _hold_timers{};
+		// hold action pressed by each key, released with the key
+		G13_Profile::LayerTable _holding;
+
+		// chord keys held back so far
+		uint64_t _pending = 0;
+		G13_TimerWheel::TimerId _chord_timer = G13_TimerWheel::NO_TIMER;
+		// action of the fired chord, released with the first of its keys
+		G13_ActionPtr _chord_action;
+		uint64_t _chord_keys = 0;
+	};
+}
+
+#endif //G13_G13_KEY_BINDINGS_H
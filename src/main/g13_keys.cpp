@@ -4,6 +4,8 @@
 
 #include "g13_device.h"
 #include "g13_keys.h"
+#include "g13_log.h"
+#include "g13_profile.h"
 
 using namespace std;
 
@@ -17,17 +19,26 @@ namespace G13 {
 		}
 	}
 
-	void G13_Key::parse_key(unsigned char* byte, G13_Device* g13) {
-		const bool key_is_down = byte[_index.offset] & _index.mask;
-		if (bool key_state_changed = g13->update(_index.index, key_is_down)) {
-			// Output the current button push regardless of attached action
-			std::ostringstream out;
-			dump(out);
-			_logger->debug(std::format("{}[{}]", out.str(), key_is_down?"DOWN":"UP"));
-			if (_action) {
- 				_action->act(key_is_down, *g13);
-			}
+	void G13_Key::set_action(const G13_ActionPtr& action) {
+		G13_Actionable<G13_Profile>::set_action(action);
+		parent()._key_action_changed(*this);
+	}
+
+	void G13_Key::key_changed(bool key_is_down, G13_Device* g13, const G13_ActionPtr& action) {
+		// Output the current button push regardless of attached action
+		G13_LOG_DEBUG(_logger, describe(key_is_down, action));
+		g13->dispatch(action, key_is_down);
+	}
+
+	std::string G13_Key::describe(bool key_is_down, const G13_ActionPtr& action) const {
+		std::ostringstream out;
+		out << _keymap->find_g13_key_name(index()) << "(" << index() << ") : ";
+		if (action) {
+			action->dump(out);
+		} else {
+			out << "(no action)";
 		}
+		return std::format("{}[{}]", out.str(), key_is_down ? "DOWN" : "UP");
 	}
 } // namespace G13
 
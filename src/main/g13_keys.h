@@ -21,9 +21,21 @@ namespace G13 {
 
 		G13_KEY_INDEX index() const { return _index.index; }
 
-		void parse_key(unsigned char* byte, G13_Device* g13);
+		/*!
+		 * binds the action of the key in every layer that does not bind the key itself
+		 */
+		void set_action(const G13_ActionPtr& action) override;
+
+		/*!
+		 * logs the state change of the key and runs the action of the active layer
+		 */
+		void key_changed(bool key_is_down, G13_Device* g13, const G13_ActionPtr& action);
 
 	protected:
+		/*!
+		 * formats the key, its action and its new state for the log
+		 */
+		std::string describe(bool key_is_down, const G13_ActionPtr& action) const;
 
 		struct KeyIndex {
 			KeyIndex(int key) :
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <string>
+
+#include "g13_latency.h"
+
+namespace G13 {
+	namespace {
+		uint64_t nanoseconds_between(G13_LatencyClock::time_point from, G13_LatencyClock::time_point to) {
+			return to > from ? std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count() : 0;
+		}
+
+		std::string format_latency(uint64_t nanoseconds) {
+			if (nanoseconds < 10000) {
+				return std::format("{:.2f}us", nanoseconds / 1000.0);
+			}
+			if (nanoseconds < 10000000) {
+				return std::format("{:.0f}us", nanoseconds / 1000.0);
+			}
+			return std::format("{:.1f}ms", nanoseconds / 1000000.0);
+		}
+
+		void dump_histogram(std::ostream& out, const char* name, const G13_LatencyHistogram& histogram) {
+			out << std::format("{:<9} count={} p50={} p99={} max={}", name, histogram.count(),
+							   format_latency(histogram.percentile(50)), format_latency(histogram.percentile(99)),
+							   format_latency(histogram.max())) << std::endl;
+		}
+	}
+
+	size_t G13_LatencyHistogram::bucket_index(uint64_t value) {
+		// The top G13_LATENCY_SUB_BUCKET_BITS + 1 bits of the value pick the bucket
+		const int shift = std::max(0, static_cast<int>(std::bit_width(value)) - (G13_LATENCY_SUB_BUCKET_BITS + 1));
+		return shift * G13_LATENCY_SUB_BUCKETS + (value >> shift);
+	}
+
+	uint64_t G13_LatencyHistogram::bucket_highest(size_t index) {
+		if (index < 2 * G13_LATENCY_SUB_BUCKETS) {
+			return index;
+		}
+		const size_t shift = index / G13_LATENCY_SUB_BUCKETS - 1;
+		const uint64_t lowest = uint64_t(index - shift * G13_LATENCY_SUB_BUCKETS) << shift;
+		return lowest + ((uint64_t(1) << shift) - 1);
+	}
+
+	void G13_LatencyHistogram::record(uint64_t nanoseconds) {
+		_buckets[bucket_index(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+		_count.fetch_add(1, std::memory_order_relaxed);
+
+		uint64_t max = _max.load(std::memory_order_relaxed);
+		while (nanoseconds > max && !_max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+		}
+	}
+
+	uint64_t G13_LatencyHistogram::percentile(double percentile) const {
+		uint64_t total = 0;
+		for (const auto& bucket : _buckets) {
+			total += bucket.load(std::memory_order_relaxed);
+		}
+		if (total == 0) {
+			return 0;
+		}
+
+		// Rank of the value we are after, counting from 1
+		const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(percentile / 100.0 * total + 0.5));
+		uint64_t seen = 0;
+		for (size_t i = 0; i < _buckets.size(); i++) {
+			seen += _buckets[i].load(std::memory_order_relaxed);
+			if (seen >= rank) {
+				// A bucket's upper end may lie beyond anything recorded
+				return std::min(bucket_highest(i), max());
+			}
+		}
+		return max();
+	}
+
+	void G13_LatencyHistogram::reset() {
+		for (auto& bucket : _buckets) {
+			bucket.store(0, std::memory_order_relaxed);
+		}
+		_count.store(0, std::memory_order_relaxed);
+		_max.store(0, std::memory_order_relaxed);
+	}
+
+	void G13_LatencyStats::record(G13_LatencyClock::time_point received, G13_LatencyClock::time_point dispatching,
+								  G13_LatencyClock::time_point dispatched, G13_LatencyClock::time_point flushed, bool wrote) {
+		_reports.fetch_add(1, std::memory_order_relaxed);
+		_queued.record(nanoseconds_between(received, dispatching));
+		_dispatch.record(nanoseconds_between(dispatching, dispatched));
+		if (wrote) {
+			_write.record(nanoseconds_between(dispatched, flushed));
+			_total.record(nanoseconds_between(received, flushed));
+		}
+	}
+
+	void G13_LatencyStats::dump(std::ostream& out) {
+		const auto now = G13_LatencyClock::now();
+		const uint64_t reports = _reports.load(std::memory_order_relaxed);
+		const std::chrono::duration<double> elapsed = now - _since;
+		const double rate = elapsed.count() > 0 ? (reports - _reports_since) / elapsed.count() : 0.0;
+		_since = now;
+		_reports_since = reports;
+
+		out << std::format("reports={} rate={:.1f}/s", reports, rate) << std::endl;
+		dump_histogram(out, "queued", _queued);
+		dump_histogram(out, "dispatch", _dispatch);
+		dump_histogram(out, "write", _write);
+		dump_histogram(out, "total", _total);
+	}
+
+	void G13_LatencyStats::reset() {
+		_reports.store(0, std::memory_order_relaxed);
+		_queued.reset();
+		_dispatch.reset();
+		_write.reset();
+		_total.reset();
+		_since = G13_LatencyClock::now();
+		_reports_since = 0;
+	}
+}
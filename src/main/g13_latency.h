@@ -0,0 +1,120 @@
+#ifndef G13_G13_LATENCY_H
+#define G13_G13_LATENCY_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+namespace G13 {
+	typedef std::chrono::steady_clock G13_LatencyClock;
+
+	// Each power of two is split into 2^G13_LATENCY_SUB_BUCKET_BITS buckets, about 6% precision
+	const int G13_LATENCY_SUB_BUCKET_BITS = 4;
+	const size_t G13_LATENCY_SUB_BUCKETS = size_t(1) << G13_LATENCY_SUB_BUCKET_BITS;
+	// Enough buckets for any 64 bit value
+	const size_t G13_LATENCY_BUCKETS = (64 - G13_LATENCY_SUB_BUCKET_BITS + 1) * G13_LATENCY_SUB_BUCKETS;
+
+	/**
+	 * @brief Log-linear histogram of nanosecond latencies, in the style of HdrHistogram.
+	 *
+	 * Values below 2 * G13_LATENCY_SUB_BUCKETS get a bucket each, above that every power of two
+	 * is split into G13_LATENCY_SUB_BUCKETS equal buckets. Recording is a few relaxed atomic
+	 * adds, so the input thread records while the worker reads without any lock. A reader may
+	 * see a value in the buckets before it shows up in count(), percentiles are approximate anyway.
+	 */
+	class G13_LatencyHistogram {
+	public:
+		/**
+		 * @brief Adds one latency.
+		 * @param nanoseconds latency to add.
+		 */
+		void record(uint64_t nanoseconds);
+
+		/**
+		 * @brief Gets the value below which the given share of the latencies lie.
+		 * @param percentile 0 to 100.
+		 * @return highest value of the bucket the percentile falls in, 0 when nothing was recorded.
+		 */
+		uint64_t percentile(double percentile) const;
+
+		uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+		uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+
+		/**
+		 * @brief Forgets all latencies. Values recorded at the same time may be partly kept.
+		 */
+		void reset();
+
+		/**
+		 * @brief Gets the bucket a value is counted in.
+		 * @param value value to look up.
+		 * @return bucket index below G13_LATENCY_BUCKETS.
+		 */
+		static size_t bucket_index(uint64_t value);
+
+		/**
+		 * @brief Gets the highest value counted in a bucket.
+		 * @param index bucket index.
+		 * @return highest value of the bucket.
+		 */
+		static uint64_t bucket_highest(size_t index);
+
+	private:
+		std::array<std::atomic<uint64_t>, G13_LATENCY_BUCKETS> _buckets{};
+		std::atomic<uint64_t> _count{0};
+		std::atomic<uint64_t> _max{0};
+	};
+
+	/**
+	 * @brief Latencies of the key reports of one device, from USB completion to the input event write.
+	 *
+	 * Each report is stamped when its transfer completes, when its actions start and end,
+	 * and after its input events were flushed. Written by whichever thread handles the
+	 * device's reports, read by the stats command on the worker.
+	 */
+	class G13_LatencyStats {
+	public:
+		G13_LatencyStats() : _since(G13_LatencyClock::now()) {}
+
+		/**
+		 * @brief Adds the timestamps of one report.
+		 * @param received completion of the USB transfer.
+		 * @param dispatching start of the report's stick and key handling.
+		 * @param dispatched end of the report's actions, before the final flush.
+		 * @param flushed after the input events were written.
+		 * @param wrote true when the report produced input events.
+		 */
+		void record(G13_LatencyClock::time_point received, G13_LatencyClock::time_point dispatching,
+					G13_LatencyClock::time_point dispatched, G13_LatencyClock::time_point flushed, bool wrote);
+
+		/**
+		 * @brief Writes reports/sec since the previous call and p50/p99/max per stage, one line each.
+		 * @param out stream that receives the statistics.
+		 */
+		void dump(std::ostream& out);
+
+		/**
+		 * @brief Forgets all latencies and restarts the report rate.
+		 */
+		void reset();
+
+	private:
+		std::atomic<uint64_t> _reports{0};
+		// USB completion until the report is handled, covers waiting in the transfer ring
+		G13_LatencyHistogram _queued;
+		// Stick and key handling including the actions that run inline
+		G13_LatencyHistogram _dispatch;
+		// The write of the report's input events
+		G13_LatencyHistogram _write;
+		// USB completion until the input events were written, only reports that wrote events
+		G13_LatencyHistogram _total;
+
+		// Only touched by dump and reset, on the worker
+		G13_LatencyClock::time_point _since;
+		uint64_t _reports_since = 0;
+	};
+}
+
+#endif //G13_G13_LATENCY_H
@@ -45,7 +45,19 @@ namespace G13 {
 		_fonts[fiveXeight->name()] = fiveXeight;
 	}
 
-	void G13_LCD::image(unsigned char* data, int size) {
+	void G13_LCD::image(unsigned char* data, int size, bool force) {
+		_frame_stats.rendered++;
+		if (size == G13_LCD_BUF_SIZE) {
+			// Nothing on screen changed, don't push the same frame over USB again
+			if (!force && _has_last_frame && memcmp(_last_frame, data, G13_LCD_BUF_SIZE) == 0) {
+				_frame_stats.skipped++;
+				return;
+			}
+			memcpy(_last_frame, data, G13_LCD_BUF_SIZE);
+			_has_last_frame = true;
+		}
+
+		_frame_stats.sent++;
 		// TODO remove circular referencing
 		_keypad.write_lcd(data, size);
 	}
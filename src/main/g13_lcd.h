@@ -5,6 +5,7 @@
 #ifndef G13_G13_LCD_H
 #define G13_G13_LCD_H
 
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 
@@ -25,16 +26,32 @@ namespace G13 {
 
 	class G13_LCD {
 	public:
+		/*!
+		 * counts of frames handed to the LCD and how many of them reached the device
+		 */
+		struct FrameStats {
+			uint64_t rendered = 0;
+			uint64_t sent = 0;
+			// frames identical to the last transmitted one
+			uint64_t skipped = 0;
+		};
+
 		G13_LCD(G13_Device& keypad, G13_Log& logger);
 
 		int text_mode;
 
-		void image(unsigned char* data, int size);
+		/*!
+		 * sends a frame to the device unless it matches the last transmitted frame
+		 * @param force send even if the frame is unchanged
+		 */
+		void image(unsigned char* data, int size, bool force = false);
 
-		void image_send() {
-			image(image_buf, G13_LCD_BUF_SIZE);
+		void image_send(bool force = false) {
+			image(image_buf, G13_LCD_BUF_SIZE, force);
 		}
 
+		const FrameStats& frame_stats() const { return _frame_stats; }
+
 		void image_clear() {
 			memset(image_buf, 0, G13_LCD_BUF_SIZE);
 		}
@@ -60,6 +77,9 @@ namespace G13 {
 			G13_Device& _keypad;
 			G13_Log& _logger;
 			unsigned char image_buf[G13_LCD_BUF_SIZE + 8];
+			unsigned char _last_frame[G13_LCD_BUF_SIZE];
+			bool _has_last_frame = false;
+			FrameStats _frame_stats;
 			unsigned cursor_row;
 			unsigned cursor_col;
 			std::map<std::string, FontPtr> _fonts;
@@ -7,6 +7,18 @@
 #include "g13_log.h"
 
 namespace G13 {
+	namespace {
+		thread_local G13_ErrorCapture* current_capture = nullptr;
+	}
+
+	G13_ErrorCapture::G13_ErrorCapture() : _outer(current_capture) {
+		current_capture = this;
+	}
+
+	G13_ErrorCapture::~G13_ErrorCapture() {
+		current_capture = _outer;
+	}
+
 	G13_Log& G13_Log::set_log_level(LogLevel lvl) {
 		level = lvl;
 
@@ -29,8 +41,14 @@ namespace G13 {
 		return *this;
 	}
 
-	void G13_Log::log(LogLevel lvl, std::string& message) {
-		if (lvl >= level || internal) {
+	void G13_Log::log(LogLevel lvl, const std::string& message) {
+		if (lvl >= LogLevel::error && current_capture) {
+			if (current_capture->failed()) {
+				current_capture->_errors += '\n';
+			}
+			current_capture->_errors += message;
+		}
+		if (enabled(lvl) || internal) {
 			const auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
 			std::chrono::system_clock::now().time_since_epoch()).count() % 1000;
 			const auto t = std::time(nullptr);
@@ -5,10 +5,33 @@
 #ifndef G13_G13_LOG_H
 #define G13_G13_LOG_H
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
 
+/*!
+ * Log levels below G13_LOG_MIN_LEVEL are compiled out of the G13_LOG_* macros,
+ * e.g. -DG13_LOG_MIN_LEVEL=2 strips trace and debug messages
+ */
+#ifndef G13_LOG_MIN_LEVEL
+#define G13_LOG_MIN_LEVEL 0
+#endif
+
+/*!
+ * Logs message at lvl. The message expression is only evaluated when the level is enabled,
+ * so hot paths pay for a single comparison when it is not
+ */
+#define G13_LOG(logger, lvl, message) \
+	do { \
+		if ((lvl) >= G13_LOG_MIN_LEVEL && (logger)->enabled(lvl)) { \
+			(logger)->log((lvl), (message)); \
+		} \
+	} while (0)
+
+#define G13_LOG_TRACE(logger, message) G13_LOG(logger, ::G13::LogLevel::trace, message)
+#define G13_LOG_DEBUG(logger, message) G13_LOG(logger, ::G13::LogLevel::debug, message)
+
 namespace G13 {
 	enum LogLevel {
 		trace,
@@ -19,6 +42,31 @@ namespace G13 {
 		fatal
 	};
 
+	/*!
+	 * collects the errors and fatal messages the current thread logs while it exists, whatever
+	 * the log level, e.g. to answer a command with its errors. Captures nest, the innermost one wins
+	 */
+	class G13_ErrorCapture {
+		public:
+			G13_ErrorCapture();
+			~G13_ErrorCapture();
+
+			G13_ErrorCapture(G13_ErrorCapture const&) = delete;
+			void operator=(G13_ErrorCapture const&) = delete;
+
+			bool failed() const { return !_errors.empty(); }
+
+			/*!
+			 * the captured messages, separated by newlines
+			 */
+			const std::string& errors() const { return _errors; }
+
+		private:
+			friend class G13_Log;
+			std::string _errors;
+			G13_ErrorCapture* _outer;
+	};
+
 	class G13_Log {
 		public:
 			static std::shared_ptr<G13_Log> get() {
@@ -32,7 +80,12 @@ namespace G13 {
 			G13_Log& set_log_level(LogLevel lvl);
 			G13_Log& set_log_level(const std::string&);
 
-			void log(LogLevel lvl, std::string& message);
+			/*!
+			 * tells whether messages at lvl are currently written
+			 */
+			bool enabled(LogLevel lvl) const { return lvl >= level.load(std::memory_order_relaxed); }
+
+			void log(LogLevel lvl, const std::string& message);
 			void trace(std::string message);
 			void debug(std::string message);
 			void info(std::string message);
@@ -42,7 +95,7 @@ namespace G13 {
 
 		private:
 			G13_Log() = default;
-			LogLevel level = LogLevel::info;
+			std::atomic<LogLevel> level = LogLevel::info;
 			bool internal = false;
 
 			std::map<std::string, LogLevel> str_to_enum = {
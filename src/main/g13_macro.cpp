@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <utility>
+
+#include <linux/input.h>
+
+#include "g13.h"
+#include "g13_device.h"
+#include "g13_log.h"
+#include "g13_macro.h"
+
+namespace G13 {
+	void G13_Macro::add_key(LINUX_KEY_VALUE key, bool down) {
+		_steps.push_back({_length, static_cast<uint16_t>(key), down});
+	}
+
+	void G13_Macro::add_tap(LINUX_KEY_VALUE key) {
+		add_key(key, true);
+		add_key(key, false);
+	}
+
+	void G13_Macro::add_delay(std::chrono::milliseconds delay) {
+		if (delay > std::chrono::milliseconds::zero()) {
+			_length += delay.count();
+		}
+	}
+
+	std::shared_ptr<G13_Macro> G13_Macro::parse(const std::string& text, const G13_KeyMap& keymap) {
+		auto macro = std::make_shared<G13_Macro>();
+		std::istringstream tokens(text);
+		std::string token;
+		while (tokens >> token) {
+			if (std::ranges::all_of(token, [](unsigned char c) { return std::isdigit(c); })) {
+				macro->add_delay(std::chrono::milliseconds(std::stoul(token)));
+				continue;
+			}
+
+			char direction = 0;
+			if (token.size() > 1 && (token.back() == '+' || token.back() == '-')) {
+				direction = token.back();
+				token.pop_back();
+			}
+			const LINUX_KEY_VALUE key = keymap.find_input_key_value(token);
+			if (key == BAD_KEY_VALUE) {
+				throw G13_CommandException("macro unknown key : " + token);
+			}
+
+			if (direction) {
+				macro->add_key(key, direction == '+');
+			} else {
+				macro->add_tap(key);
+			}
+		}
+		return macro;
+	}
+
+	void G13_Macro::dump(std::ostream& out, const G13_KeyMap& keymap) const {
+		uint32_t at = 0;
+		for (size_t i = 0; i < _steps.size(); i++) {
+			const Step& step = _steps[i];
+			if (i) out << " ";
+			if (step.at != at) {
+				out << step.at - at << " ";
+				at = step.at;
+			}
+			out << keymap.find_input_key_name(step.key);
+
+			// A press directly followed by its release is written as a tap
+			if (step.down && i + 1 < _steps.size() && _steps[i + 1].key == step.key &&
+					!_steps[i + 1].down && _steps[i + 1].at == step.at) {
+				i++;
+			} else {
+				out << (step.down ? "+" : "-");
+			}
+		}
+	}
+
+	G13_MacroPlayer::RunId G13_MacroPlayer::start(G13_MacroPtr macro) {
+		if (!macro || macro->empty()) {
+			return NO_RUN;
+		}
+
+		const RunId id = _next_id++;
+		Run run;
+		run.macro = std::move(macro);
+		run.start = G13_TimerWheel::Clock::now();
+		_runs.emplace(id, std::move(run));
+		advance(id);
+		return playing(id) ? id : NO_RUN;
+	}
+
+	void G13_MacroPlayer::advance(RunId id) {
+		const auto found = _runs.find(id);
+		if (found == _runs.end()) {
+			return;
+		}
+
+		Run& run = found->second;
+		run.timer = G13_TimerWheel::NO_TIMER;
+		const auto& steps = run.macro->steps();
+		const auto now = G13_TimerWheel::Clock::now();
+		// first step of the current input frame
+		size_t frame_start = run.next;
+		while (run.next < steps.size()) {
+			const G13_Macro::Step& step = steps[run.next];
+			const auto due = run.start + std::chrono::milliseconds(step.at);
+			if (due > now) {
+				run.timer = _device.schedule_timer(std::chrono::ceil<std::chrono::milliseconds>(due - now),
+												   [this, id] { advance(id); });
+				return;
+			}
+
+			// A key changes at most once per frame, a tap's release gets a frame of its own
+			for (size_t i = frame_start; i < run.next; i++) {
+				if (steps[i].key == step.key) {
+					_device.sync_events();
+					frame_start = run.next;
+					break;
+				}
+			}
+			_device.send_event(EV_KEY, step.key, step.down);
+			if (step.down) {
+				if (std::ranges::find(run.held, step.key) == run.held.end()) {
+					run.held.push_back(step.key);
+				}
+			} else {
+				std::erase(run.held, step.key);
+			}
+			run.next++;
+		}
+
+		// Keys the macro pressed but never released must not stick
+		release(run);
+		_runs.erase(found);
+	}
+
+	void G13_MacroPlayer::release(Run& run) {
+		for (auto key = run.held.rbegin(); key != run.held.rend(); ++key) {
+			_device.send_event(EV_KEY, *key, false);
+		}
+		run.held.clear();
+	}
+
+	bool G13_MacroPlayer::cancel(RunId id) {
+		const auto found = _runs.find(id);
+		if (found == _runs.end()) {
+			return false;
+		}
+
+		_device.cancel_timer(found->second.timer);
+		release(found->second);
+		_runs.erase(found);
+		return true;
+	}
+
+	void G13_MacroPlayer::cancel_all() {
+		for (auto& [id, run] : _runs) {
+			_device.cancel_timer(run.timer);
+			release(run);
+		}
+		_runs.clear();
+	}
+
+	G13_Action_Macro::G13_Action_Macro(std::shared_ptr<G13_Log> logger, std::shared_ptr<G13_KeyMap> keymap, G13_MacroPtr macro) :
+			G13_Action(std::move(logger), std::move(keymap)), _macro(std::move(macro)) {}
+
+	void G13_Action_Macro::act(const bool is_down, G13_Device& device) {
+		if (!is_down) {
+			return;
+		}
+
+		// Macros play to their end once started, pressing again starts over
+		device.macros().cancel(_run);
+		_run = device.macros().start(_macro);
+		G13_LOG_TRACE(_logger, "playing macro of " + std::to_string(_macro->steps().size()) + " steps");
+	}
+
+	void G13_Action_Macro::dump(std::ostream& out) const {
+		out << " PLAY MACRO: ";
+		_macro->dump(out, *_keymap);
+	}
+}
@@ -0,0 +1,139 @@
+#ifndef G13_G13_MACRO_H
+#define G13_G13_MACRO_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "g13_action.h"
+#include "g13_key_map.h"
+#include "g13_timer_wheel.h"
+
+namespace G13 {
+	class G13_Device;
+
+	/*!
+	 * compiled macro: key presses and releases in playing order, each at a fixed offset from the start
+	 */
+	class G13_Macro {
+	public:
+		struct Step {
+			// offset from the start of the macro in milliseconds
+			uint32_t at;
+			uint16_t key;
+			bool down;
+		};
+
+		/*!
+		 * appends a key press or release after all previous steps
+		 */
+		void add_key(LINUX_KEY_VALUE key, bool down);
+
+		/*!
+		 * appends a press and an immediate release of the key
+		 */
+		void add_tap(LINUX_KEY_VALUE key);
+
+		/*!
+		 * moves the time of all following steps back by the delay
+		 */
+		void add_delay(std::chrono::milliseconds delay);
+
+		/*!
+		 * parses the textual form used by bind: whitespace separated KEY_X (tap), KEY_X+ (press),
+		 * KEY_X- (release) and plain numbers (delay in milliseconds)
+		 * @throws G13_CommandException for unknown keys
+		 */
+		static std::shared_ptr<G13_Macro> parse(const std::string& text, const G13_KeyMap& keymap);
+
+		/*!
+		 * writes the macro in the textual form accepted by parse
+		 */
+		void dump(std::ostream& out, const G13_KeyMap& keymap) const;
+
+		const std::vector<Step>& steps() const { return _steps; }
+		bool empty() const { return _steps.empty(); }
+
+	private:
+		std::vector<Step> _steps;
+		uint32_t _length = 0;
+	};
+
+	typedef std::shared_ptr<const G13_Macro> G13_MacroPtr;
+
+	/*!
+	 * plays macros on the timer wheel of a device; any number of macros can play at once
+	 *
+	 * Steps that are due are sent right away and the player schedules itself for the next
+	 * step, so the input thread never sleeps. Offsets are measured from the start of the
+	 * run, a late timer does not delay the steps after it.
+	 */
+	class G13_MacroPlayer {
+	public:
+		typedef uint64_t RunId;
+		static constexpr RunId NO_RUN = 0;
+
+		explicit G13_MacroPlayer(G13_Device& device) : _device(device) {}
+
+		/*!
+		 * starts playing a macro, steps at offset zero are sent before returning
+		 * @return id for cancel, NO_RUN when the macro finished right away
+		 */
+		RunId start(G13_MacroPtr macro);
+
+		/*!
+		 * stops a run and releases the keys it still holds
+		 * @return true when the run was still playing
+		 */
+		bool cancel(RunId id);
+
+		/*!
+		 * stops all runs
+		 */
+		void cancel_all();
+
+		bool playing(RunId id) const { return _runs.contains(id); }
+		size_t size() const { return _runs.size(); }
+
+	private:
+		struct Run {
+			G13_MacroPtr macro;
+			size_t next = 0;
+			G13_TimerWheel::Clock::time_point start;
+			G13_TimerWheel::TimerId timer = G13_TimerWheel::NO_TIMER;
+			std::vector<LINUX_KEY_VALUE> held;
+		};
+
+		/*!
+		 * sends the due steps of a run, then schedules the next one or ends the run
+		 */
+		void advance(RunId id);
+		void release(Run& run);
+
+		G13_Device& _device;
+		RunId _next_id = 1;
+		std::unordered_map<RunId, Run> _runs;
+	};
+
+	/*!
+	 * action to play a macro; pressing the key again while the macro plays restarts it
+	 */
+	class G13_Action_Macro : public G13_Action {
+	public:
+		G13_Action_Macro(std::shared_ptr<G13_Log> logger, std::shared_ptr<G13_KeyMap> keymap, G13_MacroPtr macro);
+
+		void act(bool is_down, G13_Device& device) override;
+		void dump(std::ostream&) const override;
+		bool realtime() const override { return true; }
+
+	private:
+		G13_MacroPtr _macro;
+		G13_MacroPlayer::RunId _run = G13_MacroPlayer::NO_RUN;
+	};
+}
+
+#endif //G13_G13_MACRO_H
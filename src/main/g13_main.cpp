@@ -6,9 +6,8 @@
 #include <vector>
 
 #include "container.h"
-#include "G13_DisplayApp.h"
-#include "g13_action.h"
-#include "g13_key_map.h"
+#include "g13_framework.h"
+#include "g13_log.h"
 
 using namespace std;
 using namespace G13;
@@ -24,8 +23,18 @@ namespace {
 		{"config", "load config commands from file"},
 		{"pipe_in", "specify base name for input pipe"},
 		{"pipe_out", "specify base name for output pipe"},
+		{"control_socket", "specify base name for the control socket, 'off' disables it"},
+		{"raw_lcd_images", "'on' reads a single 960 byte read of the input pipe as an unframed LCD image; default is 'off'"},
 		{"log_level", "logging level; default is 'info'"},
 		{"profiles_dir", "profiles directory; default is '~/.g13d/profiles'"},
+		{"input_thread", "'on' gives every device its own input thread; default is 'off'"},
+		{"input_priority", "SCHED_FIFO priority for input threads; default is 0 (normal scheduling)"},
+		{"key_transfers", "number of key transfers kept in flight per device; default is 4"},
+		{"max_fps", "upper bound for LCD redraws per second; default is 30"},
+		{"record", "record all key reports to a report log"},
+		{"replay", "replay a report log without a G13 attached, then exit"},
+		{"replay_speed", "'recorded' replays with the recorded timing, 'max' as fast as possible; default is 'recorded'"},
+		{"backend", "'usb' drives the attached G13s, 'memory' runs one device without hardware; default is 'usb'"},
 	};
 
 	/**
@@ -141,46 +150,6 @@ namespace {
 	}
 }
 
-/**
- * @brief Loads all necessary class factories into the IoC container
- */
-void bootFramework() {
-	auto& ioc = Container::Instance();
-
-	ioc.RegisterFactory<G13_Log>([&](auto arg1, auto arg2, auto arg3) {
-		return G13_Log::get();
-	});
-	ioc.RegisterFactory<G13_Manager>([&](auto arg1, auto arg2, auto arg3) {
-		return std::make_shared<G13_Manager>(ioc.Resolve<G13_Log>(), ioc.Resolve<G13_KeyMap>());
-	});
-	ioc.RegisterFactory<G13_CurrentProfileApp>([&](auto arg1, auto arg2, auto arg3) {
-		return std::make_shared<G13_CurrentProfileApp>(ioc.Resolve<G13_Log>(), ioc.Resolve<G13_KeyMap>());
-	});
-	ioc.RegisterFactory<G13_ProfileSwitcherApp>([&](auto arg1, auto arg2, auto arg3) {
-		return std::make_shared<G13_ProfileSwitcherApp>(ioc.Resolve<G13_Log>(), ioc.Resolve<G13_KeyMap>());
-	});
-	ioc.RegisterFactory<G13_TesterApp>([&](auto arg1, auto arg2, auto arg3) {
-		return std::make_shared<G13_TesterApp>(ioc.Resolve<G13_Log>(), ioc.Resolve<G13_KeyMap>());
-	});
-	ioc.RegisterFactory<G13_KeyMap>([&](auto arg1, auto arg2, auto arg3) {
-		return G13_KeyMap::get();
-	});
-	ioc.RegisterFactory<G13_Action_Keys>([&](auto arg1, auto arg2, auto arg3) {
-		return std::make_shared<G13_Action_Keys>(ioc.Resolve<G13_Log>(), ioc.Resolve<G13_KeyMap>(), std::any_cast<std::string>(arg1));
-	});
-	ioc.RegisterFactory<G13_Action_Command>([&](auto arg1, auto arg2, auto arg3) {
-		return std::make_shared<G13_Action_Command>(ioc.Resolve<G13_Log>(), ioc.Resolve<G13_KeyMap>(), std::any_cast<std::string>(arg1));
-	});
-	ioc.RegisterFactory<G13_Action_PipeOut>([&](auto arg1, auto arg2, auto arg3) {
-		return std::make_shared<G13_Action_PipeOut>(ioc.Resolve<G13_Log>(), ioc.Resolve<G13_KeyMap>(), std::any_cast<std::string>(arg1));
-	});
-	ioc.RegisterFactory<G13_Action_AppChange>([&](auto arg1, auto arg2, auto arg3) {
-		return std::make_shared<G13_Action_AppChange>(ioc.Resolve<G13_Log>(), ioc.Resolve<G13_KeyMap>());
-	});
-
-	//TODO register logger and other services
-}
-
 int main(int argc, char* argv[]) {
 	bootFramework();
 	Container::Instance().Resolve<G13_Log>()->set_log_level("info");
@@ -2,18 +2,27 @@
 // Created by vert9 on 11/23/23.
 //
 
+#include <algorithm>
 #include <csignal>
 #include <filesystem>
 #include <format>
 #include <iostream>
 #include <sstream>
 
+#include <sys/time.h>
 #include <wordexp.h>
 #include <utility>
+#include <sys/epoll.h>
 
+#include "g13_control_server.h"
 #include "g13_device.h"
+#include "g13_event_loop.h"
+#include "g13_log.h"
 #include "g13_manager.h"
+#include "g13_memory_backend.h"
+#include "g13_report_log.h"
 #include "g13_stick.h"
+#include "g13_usb_backend.h"
 #include "helper.h"
 
 using namespace std;
@@ -23,6 +32,8 @@ using Helper::find_or_throw;
 namespace G13 {
 	G13_Manager::G13_Manager(std::shared_ptr<G13_Log> logger, std::shared_ptr<G13_KeyMap> keymap) : devs(0), ctx(0), _logger(std::move(logger)), _keymap(std::move(keymap)) {}
 
+	G13_Manager::~G13_Manager() = default;
+
 	bool G13_Manager::running = true;
 
 	void G13_Manager::set_stop(int) {
@@ -39,7 +50,8 @@ namespace G13 {
 			}
 			if (desc.idVendor == G13_VENDOR_ID && desc.idProduct == G13_PRODUCT_ID) {
 				libusb_device_handle* handle;
-				int r = libusb_open(devs[i], &handle);
+				libusb_context* device_ctx = ctx;
+				int r = input_threads_enabled() ? open_with_private_context(devs[i], device_ctx, handle) : libusb_open(devs[i], &handle);
 				if (r != 0) {
 					_logger->error("Error opening G13 device");
 					return;
@@ -55,20 +67,66 @@ namespace G13 {
 				}
 
 				auto profile_dir = string_config_value("profiles_dir", "~/.g13d/profiles");
-				auto device = new G13_Device(_logger, handle, g13s.size(), profile_dir);
+				auto device = new G13_Device(_logger, std::make_unique<G13_UsbBackend>(_logger, handle, device_ctx), g13s.size(), profile_dir);
 				g13s.push_back(device);
 				g13s.back()->init();
+				_device_contexts.push_back(device_ctx);
+			}
+		}
+	}
+
+	int G13_Manager::open_with_private_context(libusb_device* dev, libusb_context*& device_ctx, libusb_device_handle*& handle) {
+		// Each input thread handles the events of its own context, so transfers of one
+		// device never complete on another device's thread
+		const uint8_t bus = libusb_get_bus_number(dev);
+		const uint8_t address = libusb_get_device_address(dev);
+
+		const struct libusb_init_option options = {.option = LIBUSB_OPTION_LOG_LEVEL, .value = {.ival = LIBUSB_LOG_LEVEL_INFO}};
+		int r = libusb_init_context(&device_ctx, &options, 1);
+		if (r < 0) {
+			return r;
+		}
+
+		libusb_device** device_list;
+		const ssize_t count = libusb_get_device_list(device_ctx, &device_list);
+		r = LIBUSB_ERROR_NOT_FOUND;
+		for (ssize_t i = 0; i < count; i++) {
+			if (libusb_get_bus_number(device_list[i]) == bus && libusb_get_device_address(device_list[i]) == address) {
+				r = libusb_open(device_list[i], &handle);
+				break;
 			}
 		}
+		if (count >= 0) {
+			libusb_free_device_list(device_list, 1);
+		}
+
+		if (r != 0) {
+			libusb_exit(device_ctx);
+			device_ctx = ctx;
+		}
+		return r;
+	}
+
+	bool G13_Manager::input_threads_enabled() const {
+		return string_config_value("input_thread", "off") == "on";
 	}
 
 	void G13_Manager::cleanup() {
 		_logger->info("cleaning up");
+		_control_servers.clear();
+		_loop.reset();
 		for (int i = 0; i < g13s.size(); i++) {
 			g13s[i]->cleanup();
 			delete g13s[i];
 		}
-		libusb_exit(ctx);
+		for (libusb_context* device_ctx : _device_contexts) {
+			if (device_ctx != ctx) {
+				libusb_exit(device_ctx);
+			}
+		}
+		if (ctx) {
+			libusb_exit(ctx);
+		}
 	}
 
 	std::string G13_Manager::string_config_value(const std::string& name, std::string default_val) const {
@@ -84,6 +142,19 @@ namespace G13 {
 		}
 	}
 
+	int G13_Manager::int_config_value(const std::string& name, int default_val) const {
+		const std::string value = string_config_value(name);
+		if (value.empty()) {
+			return default_val;
+		}
+		try {
+			return std::stoi(value);
+		} catch (const std::exception&) {
+			_logger->warning("Ignoring invalid " + name + " " + repr(value).s);
+			return default_val;
+		}
+	}
+
 	void G13_Manager::set_string_config_value(const std::string& name, const std::string& value) {
 		_logger->info("set_string_config_value " + name + " = " + repr(value).s);
 		_string_config_values[name] = value;
@@ -92,31 +163,34 @@ namespace G13 {
 	int G13_Manager::run() {
 		display_keys();
 
-		ssize_t cnt;
-		int ret;
-
-		const struct libusb_init_option options = {.option = LIBUSB_OPTION_LOG_LEVEL, .value = {.ival = LIBUSB_LOG_LEVEL_INFO}};
-		ret = libusb_init_context(&ctx, &options, 1);
-		if (ret < 0) {
-			_logger->error("Initialization error: " + std::to_string(ret));
-			return 1;
+		if (const std::string replay = string_config_value("replay"); !replay.empty()) {
+			return replay_reports(replay);
 		}
 
-		cnt = libusb_get_device_list(ctx, &devs);
-		if (cnt < 0) {
-			_logger->error("Error while getting device list");
+		const std::string backend = string_config_value("backend", "usb");
+		if (backend == "memory") {
+			// One device without hardware, key reports are injected and its output is captured
+			auto device = new G13_Device(_logger, std::make_unique<G13_MemoryBackend>(), 0,
+										 string_config_value("profiles_dir", "~/.g13d/profiles"));
+			g13s.push_back(device);
+			device->init();
+			_device_contexts.push_back(nullptr);
+		} else if (backend == "usb") {
+			if (!open_usb()) {
+				return 1;
+			}
+		} else {
+			_logger->error("backend must be 'usb' or 'memory', not " + repr(backend).s);
 			return 1;
 		}
 
-		discover_g13s(devs, cnt, g13s);
-		libusb_free_device_list(devs, 1);
 		_logger->info("Found " + std::to_string(g13s.size()) + " G13s");
 		if (g13s.empty()) {
 			return 1;
 		}
 
-		for (int i = 0; i < g13s.size(); i++) {
-			g13s[i]->register_context(ctx, *this);
+		for (auto& g13 : g13s) {
+			g13->open_transports(*this);
 		}
 		signal(SIGINT, set_stop);
 		if (g13s.size() > 0 && logo_filename.size()) {
@@ -134,26 +208,179 @@ namespace G13 {
 
 		init_profiles();
 
-		do {
-			if (!g13s.empty()) {
-				for (auto & g13 : g13s) {
-					// TODO allow for other LCD apps to run
-					g13->display_app();
+		if (!init_event_loop()) {
+			cleanup();
+			return 1;
+		}
 
-					int status = g13->read_keys();
-					g13->read_commands();
-					int err = libusb_handle_events(ctx);
-					if(status < 0 || err != LIBUSB_SUCCESS)
-						running = false;
-				}
+		// Sleep until USB, a command pipe or the LCD timer needs attention
+		while (running) {
+			if (_loop->run_once() < 0 || _loop->usb_failed()) {
+				running = false;
 			}
 		}
-		while (running);
 		cleanup();
 
 		return 0;
 	}
 
+	bool G13_Manager::open_usb() {
+		const struct libusb_init_option options = {.option = LIBUSB_OPTION_LOG_LEVEL, .value = {.ival = LIBUSB_LOG_LEVEL_INFO}};
+		int ret = libusb_init_context(&ctx, &options, 1);
+		if (ret < 0) {
+			_logger->error("Initialization error: " + std::to_string(ret));
+			return false;
+		}
+
+		ssize_t cnt = libusb_get_device_list(ctx, &devs);
+		if (cnt < 0) {
+			_logger->error("Error while getting device list");
+			return false;
+		}
+
+		discover_g13s(devs, cnt, g13s);
+		libusb_free_device_list(devs, 1);
+		return true;
+	}
+
+	int G13_Manager::replay_reports(const std::string& filename) {
+		G13_ReportReader reader(_logger);
+		if (!reader.open(filename)) {
+			return 1;
+		}
+
+		const std::string speed = string_config_value("replay_speed", "recorded");
+		if (speed != "recorded" && speed != "max") {
+			_logger->error("replay_speed must be 'recorded' or 'max', not " + repr(speed).s);
+			return 1;
+		}
+		const bool recorded_speed = speed == "recorded";
+
+		// Events and frames are only counted, keeping them would skew the throughput
+		auto device = std::make_unique<G13_Device>(_logger, std::make_unique<G13_MemoryBackend>(0, 0), 0,
+												   string_config_value("profiles_dir", "~/.g13d/profiles"));
+		device->init();
+		if (const std::string config_fn = string_config_value("config"); !config_fn.empty()) {
+			device->read_config_file(config_fn);
+		}
+		device->init_profiles();
+
+		// Macros, holds and turbo keys still need their timers
+		G13_EventLoop loop(_logger);
+		if (!device->attach_timers(loop)) {
+			return 1;
+		}
+
+		signal(SIGINT, set_stop);
+		_logger->info("Replaying " + filename + " at " + speed + " speed");
+
+		G13_ReportRecord record;
+		uint64_t reports = 0;
+		const auto start = std::chrono::steady_clock::now();
+		auto due = start;
+		while (running && reader.next(record)) {
+			if (recorded_speed) {
+				due += record.delay;
+				for (auto now = std::chrono::steady_clock::now(); now < due; now = std::chrono::steady_clock::now()) {
+					loop.run_once(std::chrono::ceil<std::chrono::milliseconds>(due - now).count());
+				}
+			} else if (reports % 256 == 0) {
+				// Run due timers now and then without sleeping
+				loop.run_once(0);
+			}
+
+			timeval time{};
+			gettimeofday(&time, nullptr);
+			device->process_report(record.report, time, G13_LatencyClock::now());
+			reports++;
+		}
+
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		_logger->info(std::format("Replayed {} reports in {:.3f}s, {:.0f} reports/s", reports, elapsed.count(),
+								  elapsed.count() > 0 ? reports / elapsed.count() : 0.0));
+		std::ostringstream latency;
+		device->latency().dump(latency);
+		_logger->info("Report latencies:\n" + latency.str());
+		return 0;
+	}
+
+	bool G13_Manager::init_event_loop() {
+		_loop = std::make_unique<G13_EventLoop>(_logger);
+		if (ctx) {
+			_loop->watch_usb(ctx);
+		}
+
+		const int rt_priority = int_config_value("input_priority", 0);
+		const int key_transfers = int_config_value("key_transfers", G13_KEY_TRANSFERS);
+		const std::string record = string_config_value("record");
+		const int max_fps = int_config_value("max_fps", G13_DEFAULT_MAX_FPS);
+
+		for (size_t i = 0; i < g13s.size(); i++) {
+			G13_Device* g13 = g13s[i];
+			// Each display only redraws at its app's deadline or when something changed. The input
+			// thread requests redraws too, so the timer has to be set before it starts
+			const int display_timer_fd = _loop->add_timer([g13] {
+				g13->display_app();
+			});
+			if (display_timer_fd == -1) {
+				return false;
+			}
+			g13->set_display_timer(display_timer_fd, max_fps);
+
+			// The first device records to the given file, others get their id appended
+			if (!record.empty() && !g13->record_reports(i == 0 ? record : std::format("{}.{}", record, i))) {
+				return false;
+			}
+			if (g13->read_keys(std::max(key_transfers, 1)) < 0) {
+				return false;
+			}
+			// Like a failing USB context, a device that is gone stops the daemon
+			_loop->add_fd(g13->lost_fd(), EPOLLIN, [this, g13](uint32_t) {
+				_logger->error("G13 " + std::to_string(g13->id_within_manager()) + " was disconnected, stopping");
+				running = false;
+			});
+
+			// A device with its own context gets a dedicated input thread for its USB events
+			if (_device_contexts[i] != ctx) {
+				if (g13->start_input_thread(rt_priority)) {
+					_loop->add_fd(g13->deferred_fd(), EPOLLIN, [g13](uint32_t) {
+						g13->run_deferred();
+					});
+				} else {
+					_loop->watch_usb(_device_contexts[i]);
+				}
+			}
+
+			// Devices without an input thread run their timers on this loop
+			if (!g13->input_thread_running() && !g13->attach_timers(*_loop)) {
+				return false;
+			}
+
+			if (g13->input_pipe_fd() != -1) {
+				_loop->add_fd(g13->input_pipe_fd(), EPOLLIN, [g13](uint32_t) {
+					g13->read_commands();
+				});
+			}
+
+			// Like the pipes, the daemon keeps running without its socket
+			if (const std::string socket_name = g13->make_socket_name(*this); !socket_name.empty()) {
+				auto server = std::make_unique<G13_ControlServer>(_logger, *g13);
+				if (server->start(socket_name, *_loop)) {
+					_control_servers.push_back(std::move(server));
+					// Clients get the framebuffer through the socket, so it only exists along with it
+					if (g13->open_shared_framebuffer()) {
+						_loop->add_fd(g13->shared_framebuffer_fd(), EPOLLIN, [g13](uint32_t) {
+							g13->show_shared_frame();
+						});
+					}
+				}
+			}
+		}
+
+
+		return true;
+	}
+
 	void G13_Manager::init_keynames() {
 	}
 
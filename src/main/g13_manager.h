@@ -14,7 +14,9 @@
 
 namespace G13 {
 	// Forward declarations
+	class G13_ControlServer;
 	class G13_Device;
+	class G13_EventLoop;
 	class G13_KeyMap;
 	class G13_Log;
 
@@ -24,6 +26,7 @@ namespace G13 {
 	class G13_Manager {
 	public:
 		G13_Manager(std::shared_ptr<G13_Log> logger, std::shared_ptr<G13_KeyMap> keymap);
+		~G13_Manager();
 
 		void set_logo(const std::string& fn) { logo_filename = fn; }
 
@@ -31,6 +34,7 @@ namespace G13 {
 
 		std::string string_config_value(const std::string& name, std::string default_val = "") const;
 		void set_string_config_value(const std::string& name, const std::string& val);
+		int int_config_value(const std::string& name, int default_val) const;
 
 	protected:
 		void init_keynames();
@@ -39,6 +43,21 @@ namespace G13 {
 		void discover_g13s(libusb_device** devs, ssize_t count, std::vector<G13_Device*>& g13s);
 		void cleanup();
 
+		/*!
+		 * initializes libusb and opens every G13 found
+		 * @return false when libusb could not list the devices
+		 */
+		bool open_usb();
+		bool init_event_loop();
+		bool input_threads_enabled() const;
+
+		/*!
+		 * feeds a report log through a device without USB or uinput and reports the throughput
+		 * @return exit code for run()
+		 */
+		int replay_reports(const std::string& filename);
+		int open_with_private_context(libusb_device* dev, libusb_context*& device_ctx, libusb_device_handle*& handle);
+
 		std::shared_ptr<G13_Log> _logger;
 		std::shared_ptr<G13_KeyMap> _keymap;
 
@@ -46,6 +65,9 @@ namespace G13 {
 		libusb_device** devs;
 		libusb_context* ctx;
 		std::vector<G13_Device*> g13s;
+		std::vector<libusb_context*> _device_contexts;
+		std::unique_ptr<G13_EventLoop> _loop;
+		std::vector<std::unique_ptr<G13_ControlServer>> _control_servers;
 
 		std::map<std::string, std::string> _string_config_values;
 
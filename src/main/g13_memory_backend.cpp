@@ -0,0 +1,102 @@
+#include <cstring>
+#include <format>
+
+#include "g13_memory_backend.h"
+
+namespace G13 {
+	bool G13_MemoryKeyEndpoint::start(size_t, REPORT_CALLBACK callback, DEVICE_LOST_CALLBACK) {
+		if (!_started) {
+			_callback = std::move(callback);
+			_started = true;
+		}
+		return true;
+	}
+
+	bool G13_MemoryKeyEndpoint::inject(const unsigned char* report) {
+		if (!_started) {
+			return false;
+		}
+
+		// The callback gets its own copy, like a transfer buffer
+		unsigned char buffer[G13_REPORT_SIZE];
+		memcpy(buffer, report, sizeof(buffer));
+		timeval time{};
+		gettimeofday(&time, nullptr);
+		_injected++;
+		_callback(buffer, time, G13_LatencyClock::now());
+		return true;
+	}
+
+	void G13_MemoryKeyEndpoint::dump(std::ostream& out) const {
+		out << "   memory_keys injected=" << _injected << std::endl;
+	}
+
+	void G13_MemoryLcdEndpoint::write(const unsigned char* frame) {
+		std::lock_guard lock(_mutex);
+		_count++;
+		if (_frame_limit == 0) {
+			return;
+		}
+		if (_frames.size() == _frame_limit) {
+			_frames.pop_front();
+		}
+		memcpy(_frames.emplace_back().data(), frame, G13_LCD_BUFFER_SIZE);
+	}
+
+	std::vector<G13_LcdFrame> G13_MemoryLcdEndpoint::frames() const {
+		std::lock_guard lock(_mutex);
+		return {_frames.begin(), _frames.end()};
+	}
+
+	uint64_t G13_MemoryLcdEndpoint::frame_count() const {
+		std::lock_guard lock(_mutex);
+		return _count;
+	}
+
+	void G13_MemoryLcdEndpoint::dump(std::ostream& out) const {
+		std::lock_guard lock(_mutex);
+		out << "   memory_lcd frames=" << _count << " kept=" << _frames.size() << std::endl;
+	}
+
+	bool G13_MemoryLedControl::set_mode_leds(int leds) {
+		_mode_leds = leds;
+		return true;
+	}
+
+	bool G13_MemoryLedControl::set_key_color(int red, int green, int blue) {
+		_key_color = (red & 0xff) << 16 | (green & 0xff) << 8 | (blue & 0xff);
+		return true;
+	}
+
+	void G13_MemoryEventSink::write(const input_event* events, size_t count) {
+		std::lock_guard lock(_mutex);
+		_count += count;
+		if (_event_limit == 0) {
+			return;
+		}
+		_events.insert(_events.end(), events, events + count);
+		if (_events.size() > _event_limit) {
+			_events.erase(_events.begin(), _events.begin() + (_events.size() - _event_limit));
+		}
+	}
+
+	std::vector<input_event> G13_MemoryEventSink::take_events() {
+		std::lock_guard lock(_mutex);
+		std::vector<input_event> events(_events.begin(), _events.end());
+		_events.clear();
+		return events;
+	}
+
+	uint64_t G13_MemoryEventSink::event_count() const {
+		std::lock_guard lock(_mutex);
+		return _count;
+	}
+
+	void G13_MemoryBackend::dump(std::ostream& out) const {
+		_keys.dump(out);
+		_lcd.dump(out);
+		out << "   memory_leds mode=" << _leds.mode_leds() << " color=" << std::format("{:06x}", _leds.key_color())
+			<< std::endl;
+		out << "   memory_events written=" << _events.event_count() << std::endl;
+	}
+}
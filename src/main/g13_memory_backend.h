@@ -0,0 +1,148 @@
+#ifndef G13_G13_MEMORY_BACKEND_H
+#define G13_G13_MEMORY_BACKEND_H
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "g13_device.h"
+#include "g13_transport.h"
+
+namespace G13 {
+	// Input events a memory backend keeps until they are taken, older ones are dropped
+	const size_t G13_MEMORY_EVENT_LIMIT = 65536;
+	// LCD frames a memory backend keeps, older ones are dropped
+	const size_t G13_MEMORY_FRAME_LIMIT = 16;
+
+	typedef std::array<unsigned char, G13_LCD_BUFFER_SIZE> G13_LcdFrame;
+
+	/**
+	 * @brief Delivers key reports handed to it by inject().
+	 */
+	class G13_MemoryKeyEndpoint : public G13_KeyEndpoint {
+	public:
+		bool start(size_t transfer_count, REPORT_CALLBACK callback, DEVICE_LOST_CALLBACK lost) override;
+		void stop() override { _started = false; }
+		void dump(std::ostream& out) const override;
+
+		/**
+		 * @brief Delivers a report right away, on the calling thread.
+		 * @param report raw G13_REPORT_SIZE byte report.
+		 * @return false when the endpoint was not started.
+		 */
+		bool inject(const unsigned char* report);
+
+	private:
+		REPORT_CALLBACK _callback;
+		bool _started = false;
+		uint64_t _injected = 0;
+	};
+
+	/**
+	 * @brief Keeps the most recent LCD frames.
+	 */
+	class G13_MemoryLcdEndpoint : public G13_LcdEndpoint {
+	public:
+		explicit G13_MemoryLcdEndpoint(size_t frame_limit) : _frame_limit(frame_limit) {}
+
+		void init() override {}
+		void write(const unsigned char* frame) override;
+		void stop() override {}
+		void dump(std::ostream& out) const override;
+
+		/**
+		 * @brief Gets the kept frames, oldest first.
+		 * @return copy of the kept frames.
+		 */
+		std::vector<G13_LcdFrame> frames() const;
+
+		uint64_t frame_count() const;
+
+	private:
+		mutable std::mutex _mutex;
+		size_t _frame_limit;
+		std::deque<G13_LcdFrame> _frames;
+		uint64_t _count = 0;
+	};
+
+	/**
+	 * @brief Remembers the last LED state.
+	 */
+	class G13_MemoryLedControl : public G13_LedControl {
+	public:
+		bool set_mode_leds(int leds) override;
+		bool set_key_color(int red, int green, int blue) override;
+
+		int mode_leds() const { return _mode_leds; }
+		// 0xRRGGBB
+		int key_color() const { return _key_color; }
+
+	private:
+		std::atomic<int> _mode_leds{0};
+		std::atomic<int> _key_color{0};
+	};
+
+	/**
+	 * @brief Keeps the input events written to it until they are taken.
+	 */
+	class G13_MemoryEventSink : public G13_EventSink {
+	public:
+		explicit G13_MemoryEventSink(size_t event_limit) : _event_limit(event_limit) {}
+
+		bool open() override { return true; }
+		void write(const input_event* events, size_t count) override;
+		void close() override {}
+
+		/**
+		 * @brief Removes and returns the kept events, oldest first.
+		 * @return the kept events.
+		 */
+		std::vector<input_event> take_events();
+
+		/**
+		 * @brief Counts every event written, including dropped ones.
+		 * @return number of events written.
+		 */
+		uint64_t event_count() const;
+
+	private:
+		mutable std::mutex _mutex;
+		size_t _event_limit;
+		std::deque<input_event> _events;
+		uint64_t _count = 0;
+	};
+
+	/**
+	 * @brief Backend without hardware: reports are injected, events and frames are captured.
+	 *
+	 * Lets the daemon run headless in tests and benchmarks. With limits of zero nothing is
+	 * kept and the backend only counts.
+	 */
+	class G13_MemoryBackend : public G13_Backend {
+	public:
+		explicit G13_MemoryBackend(size_t event_limit = G13_MEMORY_EVENT_LIMIT, size_t frame_limit = G13_MEMORY_FRAME_LIMIT) :
+				_lcd(frame_limit), _events(event_limit) {}
+
+		G13_KeyEndpoint& keys() override { return _keys; }
+		G13_LcdEndpoint& lcd() override { return _lcd; }
+		G13_LedControl& leds() override { return _leds; }
+		G13_EventSink& events() override { return _events; }
+		const char* name() const override { return "memory"; }
+		void dump(std::ostream& out) const override;
+
+		G13_MemoryKeyEndpoint& memory_keys() { return _keys; }
+		G13_MemoryLcdEndpoint& memory_lcd() { return _lcd; }
+		G13_MemoryLedControl& memory_leds() { return _leds; }
+		G13_MemoryEventSink& memory_events() { return _events; }
+
+	private:
+		G13_MemoryKeyEndpoint _keys;
+		G13_MemoryLcdEndpoint _lcd;
+		G13_MemoryLedControl _leds;
+		G13_MemoryEventSink _events;
+	};
+}
+
+#endif //G13_G13_MEMORY_BACKEND_H
@@ -2,11 +2,15 @@
 // Created by vert9 on 11/23/23.
 //
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <ostream>
 
+#include "g13.h"
 #include "helper.h"
 #include "g13_device.h"
+#include "g13_key_bindings.h"
 #include "g13_keys.h"
 #include "g13_manager.h"
 #include "g13_profile.h"
@@ -14,6 +18,26 @@
 using Helper::repr;
 
 namespace G13 {
+	static_assert(std::tuple_size_v<G13_Profile::LayerTable> == G13_NUM_KEYS);
+
+	G13_Profile::G13_Profile(const G13_Profile& other, std::string guid, std::string name) :
+			_parse_mask(other._parse_mask), _layer_key_mask(other._layer_key_mask), _first_layer_key(other._first_layer_key),
+			_name(std::move(name)), _guid(std::move(guid)) {
+		_keymap = Container::Instance().Resolve<G13_KeyMap>();
+
+		// The keys must point at this profile, not at the one they were copied from
+		_keys.reserve(other._keys.size());
+		for (const auto& key : other._keys) {
+			_keys.push_back(G13_Key(*this, key));
+		}
+		_layers = other._layers;
+		_layer_overrides = other._layer_overrides;
+		_holds = other._holds;
+		_hold_mask = other._hold_mask;
+		_chords = other._chords;
+		_rebuild_chord_tables();
+	}
+
 	void G13_Profile::_init_keys() {
 		int key_index = 0;
 
@@ -31,6 +55,37 @@ namespace G13 {
 			assert(key);
 			key->_should_parse = false;
 		}
+
+		_parse_mask = 0;
+		for (const auto& key : _keys) {
+			if (key._should_parse) {
+				_parse_mask |= uint64_t(1) << key.index();
+			}
+		}
+
+		_first_layer_key = _keymap->find_g13_key_value("M1");
+		_layer_key_mask = ((uint64_t(1) << G13_NUM_LAYERS) - 1) << _first_layer_key;
+	}
+
+	void G13_Profile::_key_action_changed(const G13_Key& key) {
+		const uint64_t bit = uint64_t(1) << key.index();
+		for (int layer = 0; layer < G13_NUM_LAYERS; layer++) {
+			if (!(_layer_overrides[layer] & bit)) {
+				_layers[layer][key.index()] = key.action();
+			}
+		}
+	}
+
+	void G13_Profile::set_layer_action(int layer, G13_KEY_INDEX index, const G13_ActionPtr& action) {
+		assert(layer >= 0 && layer < G13_NUM_LAYERS && index >= 0 && index < _keys.size());
+		const uint64_t bit = uint64_t(1) << index;
+		if (action) {
+			_layer_overrides[layer] |= bit;
+			_layers[layer][index] = action;
+		} else {
+			_layer_overrides[layer] &= ~bit;
+			_layers[layer][index] = _keys[index].action();
+		}
 	}
 
 	void G13_Profile::dump(std::ostream& o) const {
@@ -42,17 +97,138 @@ namespace G13 {
 				o << std::endl;
 			}
 		}
+		for (int layer = 0; layer < G13_NUM_LAYERS; layer++) {
+			for (const auto& key : _keys) {
+				if (_layer_overrides[layer] >> key.index() & 1) {
+					o << "   M" << layer + 1 << ":" << _keymap->find_g13_key_name(key.index()) << " : ";
+					if (const auto& action = _layers[layer][key.index()]) {
+						action->dump(o);
+					} else {
+						o << "(no action)";
+					}
+					o << std::endl;
+				}
+			}
+		}
+		for (const auto& key : _keys) {
+			if (const auto& hold = _holds[key.index()]; hold.action) {
+				o << "   HOLD " << _keymap->find_g13_key_name(key.index()) << " " << hold.delay.count() << "ms : ";
+				hold.action->dump(o);
+				o << std::endl;
+			}
+		}
+		for (const auto& chord : _chords) {
+			o << "   CHORD ";
+			for (uint64_t keys = chord.keys; keys; keys &= keys - 1) {
+				o << _keymap->find_g13_key_name(std::countr_zero(keys)) << (keys & (keys - 1) ? "+" : "");
+			}
+			o << " : ";
+			chord.action->dump(o);
+			o << std::endl;
+		}
 	}
 
 	void G13_Profile::parse_keys(unsigned char* buf, G13_Device& device) {
+		// The 40 key bits follow the stick position, key N is bit N % 8 of byte N / 8
 		buf += 3;
-		for (size_t i = 0; i < _keys.size(); i++) {
-			if (_keys[i]._should_parse) {
-				_keys[i].parse_key(buf, &device);
+		uint64_t report = 0;
+		for (size_t i = 0; i < G13_NUM_KEYS / 8; i++) {
+			report |= uint64_t(buf[i]) << (i * 8);
+		}
+		report &= _parse_mask;
+
+		// Only visit the keys that changed since the previous report
+		uint64_t changed = device.update_keys(report);
+		const uint64_t bound = _hold_mask | _chord_mask;
+		while (changed) {
+			const int index = std::countr_zero(changed);
+			changed &= changed - 1;
+			const bool is_down = report >> index & 1;
+			// A key pressed under a profile with hold or chord bindings ends its phase there
+			if ((bound >> index & 1) || device.key_bindings().active(index)) {
+				device.key_bindings().key_changed(index, is_down);
+			} else if (is_down) {
+				press_key(index, device);
+			} else {
+				release_key(index, device);
+			}
+		}
+	}
+
+	void G13_Profile::press_key(G13_KEY_INDEX index, G13_Device& device) {
+		// M-keys switch the layer before their own action runs
+		if (_layer_key_mask >> index & 1) {
+			device.set_layer(index - _first_layer_key);
+		}
+		G13_ActionPtr& pressed = device.pressed_action(index);
+		pressed = _layers[device.layer()][index];
+		_keys[index].key_changed(true, &device, pressed);
+	}
+
+	void G13_Profile::release_key(G13_KEY_INDEX index, G13_Device& device) {
+		// Release what was pressed, even when the layer or the profile changed in between
+		G13_ActionPtr& pressed = device.pressed_action(index);
+		_keys[index].key_changed(false, &device, pressed);
+		pressed.reset();
+	}
+
+	void G13_Profile::set_hold_action(G13_KEY_INDEX index, std::chrono::milliseconds delay, const G13_ActionPtr& action) {
+		assert(index >= 0 && index < _keys.size());
+		const uint64_t bit = uint64_t(1) << index;
+		if (action) {
+			_holds[index] = {delay, action};
+			_hold_mask |= bit;
+		} else {
+			_holds[index] = {};
+			_hold_mask &= ~bit;
+		}
+	}
+
+	void G13_Profile::set_chord_action(uint64_t keys, const G13_ActionPtr& action) {
+		if (std::popcount(keys) < 2) {
+			throw G13_CommandException("a chord needs at least two keys");
+		}
+
+		const auto found = std::ranges::find_if(_chords, [keys](const ChordBinding& chord) {
+			return chord.keys == keys;
+		});
+		if (!action) {
+			if (found != _chords.end()) {
+				_chords.erase(found);
+			}
+		} else if (found != _chords.end()) {
+			found->action = action;
+		} else if (_chords.size() == G13_MAX_CHORDS) {
+			throw G13_CommandException("too many chords");
+		} else {
+			_chords.push_back({keys, action});
+		}
+		_rebuild_chord_tables();
+	}
+
+	void G13_Profile::_rebuild_chord_tables() {
+		_chord_mask = 0;
+		_chords_by_key.fill(0);
+		for (size_t chord = 0; chord < _chords.size(); chord++) {
+			_chord_mask |= _chords[chord].keys;
+			for (uint64_t keys = _chords[chord].keys; keys; keys &= keys - 1) {
+				_chords_by_key[std::countr_zero(keys)] |= uint64_t(1) << chord;
 			}
 		}
 	}
 
+	uint64_t G13_Profile::chord_candidates(uint64_t keys) const {
+		if (!keys) {
+			return 0;
+		}
+		uint64_t candidates = ~uint64_t(0);
+		while (keys && candidates) {
+			candidates &= _chords_by_key[std::countr_zero(keys)];
+			keys &= keys - 1;
+		}
+		return candidates;
+	}
+
 	G13_Key* G13_Profile::find_key(const std::string& keyname) {
 
 		auto key = _keymap->find_g13_key_value(keyname);
@@ -5,13 +5,23 @@
 #ifndef G13_G13_PROFILE_H
 #define G13_G13_PROFILE_H
 
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "g13_action.h"
 #include "g13_key_map.h"
 
 namespace G13 {
+	// M1, M2 and M3 each select a binding layer
+	const int G13_NUM_LAYERS = 3;
+	// chords are numbered by the bits of a 64 bit mask
+	const size_t G13_MAX_CHORDS = 64;
+
 	class G13_Key;
 	class G13_Device;
 	class G13_Manager;
@@ -24,19 +34,79 @@ namespace G13 {
 	 */
 	class G13_Profile {
 	public:
+		/*!
+		 * actions of all keys in one layer, indexed by key index
+		 */
+		typedef std::array<G13_ActionPtr, std::size(G13_KEY_SEQ)> LayerTable;
+
+		/*!
+		 * action pressed instead of the layer action once a key is held past the delay
+		 */
+		struct HoldBinding {
+			std::chrono::milliseconds delay{0};
+			G13_ActionPtr action;
+		};
+
+		/*!
+		 * action pressed when all keys of the mask are pressed together
+		 */
+		struct ChordBinding {
+			uint64_t keys = 0;
+			G13_ActionPtr action;
+		};
+
 		G13_Profile(std::string guid, std::string  name = "") :
 				_name(std::move(name)), _guid(std::move(guid)) {
 			_keymap = Container::Instance().Resolve<G13_KeyMap>();
 			_init_keys();
 		}
-		G13_Profile(const G13_Profile& other, std::string  guid, std::string  name = "") :
-				_keys(other._keys), _name(std::move(name)), _guid(std::move(guid)) {
-			_keymap = Container::Instance().Resolve<G13_KeyMap>();
-		}
+		G13_Profile(const G13_Profile& other, std::string  guid, std::string  name = "");
 
 		// search key by G13 keyname
 		G13_Key* find_key(const std::string& keyname);
 
+		/*!
+		 * binds an action to a key in one layer only, nullptr falls back to the key's own action again
+		 * @param layer 0 for M1 up to G13_NUM_LAYERS - 1 for M3
+		 */
+		void set_layer_action(int layer, G13_KEY_INDEX index, const G13_ActionPtr& action);
+
+		/*!
+		 * binds the action a key presses when held past the delay, nullptr removes it
+		 */
+		void set_hold_action(G13_KEY_INDEX index, std::chrono::milliseconds delay, const G13_ActionPtr& action);
+
+		/*!
+		 * binds the action pressed by a chord, nullptr removes it
+		 * @param keys mask of at least two key indexes
+		 * @throws G13_CommandException for masks of one key or too many chords
+		 */
+		void set_chord_action(uint64_t keys, const G13_ActionPtr& action);
+
+		const HoldBinding& hold(G13_KEY_INDEX index) const { return _holds[index]; }
+		const ChordBinding& chord(int chord) const { return _chords[chord]; }
+
+		/*!
+		 * finds the chords that contain all the keys
+		 * @return bit N set for chord N
+		 */
+		uint64_t chord_candidates(uint64_t keys) const;
+
+		// keys with a hold binding
+		uint64_t hold_mask() const { return _hold_mask; }
+		// keys that are part of a chord
+		uint64_t chord_mask() const { return _chord_mask; }
+
+		/*!
+		 * presses the action of the key in the active layer, an M-key switches the layer first
+		 */
+		void press_key(G13_KEY_INDEX index, G13_Device& device);
+
+		/*!
+		 * releases the action the key was pressed with, which the device keeps across profile switches
+		 */
+		void release_key(G13_KEY_INDEX index, G13_Device& device);
+
 		void dump(std::ostream& o) const;
 
 		void parse_keys(unsigned char* buf, G13_Device& device);
@@ -46,10 +116,33 @@ namespace G13 {
 	protected:
 		std::shared_ptr<G13_KeyMap> _keymap;
 		std::vector<G13_Key> _keys;
+		// bit N is set when key index N is read from the key report
+		uint64_t _parse_mask = 0;
+		// bit N is set for the M-keys that select a layer
+		uint64_t _layer_key_mask = 0;
+		G13_KEY_INDEX _first_layer_key = 0;
 		std::string _name;
 		std::string _guid;
 
+		// Every layer holds the resolved action of every key, a key press is a single lookup
+		std::array<LayerTable, G13_NUM_LAYERS> _layers;
+		// bit N of a layer is set when the layer binds key N itself instead of using the key's action
+		std::array<uint64_t, G13_NUM_LAYERS> _layer_overrides{};
+
+		std::array<HoldBinding, std::size(G13_KEY_SEQ)> _holds;
+		uint64_t _hold_mask = 0;
+		std::vector<ChordBinding> _chords;
+		uint64_t _chord_mask = 0;
+		// bit N of an entry is set when chord N contains that key
+		std::array<uint64_t, std::size(G13_KEY_SEQ)> _chords_by_key{};
+
+		void _rebuild_chord_tables();
+
 		void _init_keys();
+
+		// G13_Key reports changes of its own action, which all layers without an override use
+		friend class G13_Key;
+		void _key_action_changed(const G13_Key& key);
 	};
 }
 #endif //G13_G13_PROFILE_H
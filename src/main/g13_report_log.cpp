@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "g13_log.h"
+#include "g13_report_log.h"
+
+namespace G13 {
+	namespace {
+		const char REPORT_LOG_MAGIC[8] = {'G', '1', '3', 'R', 'L', 'O', 'G', '1'};
+		const size_t REPORT_LOG_RECORD_SIZE = 4 + G13_REPORT_LOG_REPORT_SIZE;
+		const size_t REPORT_LOG_BUFFER_SIZE = 64 * 1024;
+	}
+
+	G13_ReportRecorder::~G13_ReportRecorder() {
+		if (_file) {
+			fclose(_file);
+			_logger->info("Recorded " + std::to_string(_count) + " key reports");
+		}
+	}
+
+	bool G13_ReportRecorder::open(const std::string& filename) {
+		_file = fopen(filename.c_str(), "wb");
+		if (!_file) {
+			_logger->error("Cannot record key reports to " + filename + ": " + strerror(errno));
+			return false;
+		}
+		setvbuf(_file, nullptr, _IOFBF, REPORT_LOG_BUFFER_SIZE);
+		fwrite(REPORT_LOG_MAGIC, sizeof(REPORT_LOG_MAGIC), 1, _file);
+		_last = std::chrono::steady_clock::now();
+		return true;
+	}
+
+	void G13_ReportRecorder::record(const unsigned char* report, std::chrono::steady_clock::time_point received) {
+		// Handling time would add the dispatch jitter of each report to the recorded gaps
+		const auto delay = std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(received - _last).count(), 0);
+		_last = std::max(_last, received);
+
+		// Gaps of more than an hour are shortened, they only matter for replays at recorded speed
+		const uint32_t stored = delay > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(delay);
+		unsigned char record[REPORT_LOG_RECORD_SIZE];
+		for (int i = 0; i < 4; i++) {
+			record[i] = stored >> (i * 8);
+		}
+		memcpy(record + 4, report, G13_REPORT_LOG_REPORT_SIZE);
+		fwrite(record, sizeof(record), 1, _file);
+		_count++;
+	}
+
+	G13_ReportReader::~G13_ReportReader() {
+		if (_file) {
+			fclose(_file);
+		}
+	}
+
+	bool G13_ReportReader::open(const std::string& filename) {
+		_file = fopen(filename.c_str(), "rb");
+		if (!_file) {
+			_logger->error("Cannot open report log " + filename + ": " + strerror(errno));
+			return false;
+		}
+
+		char magic[sizeof(REPORT_LOG_MAGIC)];
+		if (fread(magic, sizeof(magic), 1, _file) != 1 || memcmp(magic, REPORT_LOG_MAGIC, sizeof(magic)) != 0) {
+			_logger->error(filename + " is not a key report log");
+			return false;
+		}
+		return true;
+	}
+
+	bool G13_ReportReader::next(G13_ReportRecord& record) {
+		unsigned char buffer[REPORT_LOG_RECORD_SIZE];
+		if (fread(buffer, sizeof(buffer), 1, _file) != 1) {
+			return false;
+		}
+
+		uint32_t delay = 0;
+		for (int i = 0; i < 4; i++) {
+			delay |= uint32_t(buffer[i]) << (i * 8);
+		}
+		record.delay = std::chrono::microseconds(delay);
+		memcpy(record.report, buffer + 4, G13_REPORT_LOG_REPORT_SIZE);
+		return true;
+	}
+}
@@ -0,0 +1,90 @@
+#ifndef G13_G13_REPORT_LOG_H
+#define G13_G13_REPORT_LOG_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace G13 {
+	class G13_Log;
+
+	// Size of one key report on the wire, G13_REPORT_SIZE in g13_device.h
+	const size_t G13_REPORT_LOG_REPORT_SIZE = 8;
+
+	/**
+	 * @brief One key report of a report log.
+	 *
+	 * A log starts with the 8 byte magic "G13RLOG1" followed by 12 byte records: the
+	 * microseconds since the previous report (monotonic clock, little endian) and the raw report.
+	 */
+	struct G13_ReportRecord {
+		std::chrono::microseconds delay{0};
+		unsigned char report[G13_REPORT_LOG_REPORT_SIZE] {};
+	};
+
+	/**
+	 * @brief Appends raw key reports to a report log.
+	 *
+	 * Writes go through a large stdio buffer, so recording only touches the disk every few
+	 * thousand reports. Meant for capturing sessions, not for always-on use.
+	 */
+	class G13_ReportRecorder {
+	public:
+		explicit G13_ReportRecorder(std::shared_ptr<G13_Log> logger) : _logger(std::move(logger)) {}
+		~G13_ReportRecorder();
+
+		/**
+		 * @brief Creates or truncates the log file and writes its header.
+		 * @param filename path of the log.
+		 * @return true when the log can be written.
+		 */
+		bool open(const std::string& filename);
+
+		/**
+		 * @brief Appends a report, stamped with the time its transfer completed.
+		 * @param report raw report of G13_REPORT_LOG_REPORT_SIZE bytes.
+		 * @param received monotonic time the report arrived, taken in the transfer callback.
+		 */
+		void record(const unsigned char* report, std::chrono::steady_clock::time_point received);
+
+		uint64_t count() const { return _count; }
+
+	private:
+		std::shared_ptr<G13_Log> _logger;
+		FILE* _file = nullptr;
+		std::chrono::steady_clock::time_point _last;
+		uint64_t _count = 0;
+	};
+
+	/**
+	 * @brief Reads the reports of a report log in order.
+	 */
+	class G13_ReportReader {
+	public:
+		explicit G13_ReportReader(std::shared_ptr<G13_Log> logger) : _logger(std::move(logger)) {}
+		~G13_ReportReader();
+
+		/**
+		 * @brief Opens a log and checks its header.
+		 * @param filename path of the log.
+		 * @return true when the file is a report log.
+		 */
+		bool open(const std::string& filename);
+
+		/**
+		 * @brief Reads the next report.
+		 * @param record receives the report and its delay.
+		 * @return false at the end of the log.
+		 */
+		bool next(G13_ReportRecord& record);
+
+	private:
+		std::shared_ptr<G13_Log> _logger;
+		FILE* _file = nullptr;
+	};
+}
+
+#endif //G13_G13_REPORT_LOG_H
@@ -0,0 +1,84 @@
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "g13_log.h"
+#include "g13_shared_framebuffer.h"
+
+namespace G13 {
+	G13_SharedFramebuffer::~G13_SharedFramebuffer() {
+		if (_layout) {
+			munmap(_layout, sizeof(G13_SharedFrameLayout));
+		}
+		if (_memory_fd != -1) {
+			close(_memory_fd);
+		}
+		if (_doorbell_fd != -1) {
+			close(_doorbell_fd);
+		}
+	}
+
+	bool G13_SharedFramebuffer::open(const std::string& name) {
+		_memory_fd = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (_memory_fd == -1) {
+			_logger->error(std::string("failed creating shared framebuffer: ") + strerror(errno));
+			return false;
+		}
+		if (ftruncate(_memory_fd, sizeof(G13_SharedFrameLayout)) != 0 ||
+			fcntl(_memory_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+			_logger->error(std::string("failed sizing shared framebuffer: ") + strerror(errno));
+			return false;
+		}
+
+		void* memory = mmap(nullptr, sizeof(G13_SharedFrameLayout), PROT_READ | PROT_WRITE, MAP_SHARED, _memory_fd, 0);
+		if (memory == MAP_FAILED) {
+			_logger->error(std::string("failed mapping shared framebuffer: ") + strerror(errno));
+			return false;
+		}
+		_layout = new(memory) G13_SharedFrameLayout{};
+		_layout->magic = G13_SHARED_FRAME_MAGIC;
+		_layout->version = G13_SHARED_FRAME_VERSION;
+		_layout->slots = G13_SHARED_FRAME_SLOTS;
+		_layout->width = G13_LCD_COLUMNS;
+		_layout->height = G13_LCD_ROWS;
+		_layout->frame_size = G13_LCD_BUFFER_SIZE;
+
+		_doorbell_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (_doorbell_fd == -1) {
+			_logger->error(std::string("failed creating shared framebuffer doorbell: ") + strerror(errno));
+			return false;
+		}
+		return true;
+	}
+
+	unsigned char* G13_SharedFramebuffer::take_frame(uint64_t& sequence) {
+		// Rings since the last take are answered with the newest frame only
+		eventfd_t rings;
+		eventfd_read(_doorbell_fd, &rings);
+
+		sequence = _layout->sequence.load(std::memory_order_acquire);
+		if (sequence == _taken) {
+			return nullptr;
+		}
+		if (sequence > _taken) {
+			_coalesced += sequence - _taken - 1;
+		}
+		_taken = sequence;
+		_frames++;
+		return _layout->frames[sequence % G13_SHARED_FRAME_SLOTS];
+	}
+
+	void G13_SharedFramebuffer::shown(uint64_t sequence) {
+		_layout->shown.store(sequence, std::memory_order_release);
+	}
+
+	void G13_SharedFramebuffer::dump(std::ostream& out) const {
+		out << "   shared_framebuffer frames=" << _frames << " coalesced=" << _coalesced << " sequence=" << sequence()
+			<< std::endl;
+	}
+}
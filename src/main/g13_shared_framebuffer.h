@@ -0,0 +1,105 @@
+#ifndef G13_G13_SHARED_FRAMEBUFFER_H
+#define G13_G13_SHARED_FRAMEBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "g13_device.h"
+
+namespace G13 {
+	class G13_Log;
+
+	// "G13F" in little endian
+	const uint32_t G13_SHARED_FRAME_MAGIC = 0x46333147;
+	const uint16_t G13_SHARED_FRAME_VERSION = 1;
+	const uint16_t G13_SHARED_FRAME_SLOTS = 2;
+
+	/**
+	 * @brief Layout of the shared memory, read and written by other processes.
+	 *
+	 * Frame N is drawn into frames[N % G13_SHARED_FRAME_SLOTS] in the LCD page layout, then
+	 * sequence is set to N and the doorbell is rung. The daemon shows the newest sequence and
+	 * sets shown to it once the frame was pushed. A client draws frame N + 1 only when shown is
+	 * at least N - 1, as the daemon may still be reading that slot otherwise.
+	 */
+	struct G13_SharedFrameLayout {
+		uint32_t magic;
+		uint16_t version;
+		uint16_t slots;
+		uint16_t width;
+		uint16_t height;
+		uint32_t frame_size;
+		// newest published frame
+		std::atomic<uint64_t> sequence;
+		// newest frame the daemon has pushed to the LCD
+		std::atomic<uint64_t> shown;
+		alignas(64) unsigned char frames[G13_SHARED_FRAME_SLOTS][G13_LCD_BUFFER_SIZE];
+	};
+
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared sequence counters need lock free atomics");
+	static_assert(offsetof(G13_SharedFrameLayout, sequence) == 16);
+	static_assert(offsetof(G13_SharedFrameLayout, shown) == 24);
+	static_assert(offsetof(G13_SharedFrameLayout, frames) == 64);
+
+	/**
+	 * @brief LCD framebuffer in a memfd that clients map and draw into, with an eventfd doorbell.
+	 *
+	 * Frames are pushed straight from the shared mapping, nothing is read through a pipe. The
+	 * memfd is sealed against resizing, so a client cannot make the daemon's mapping fault.
+	 */
+	class G13_SharedFramebuffer {
+	public:
+		explicit G13_SharedFramebuffer(std::shared_ptr<G13_Log> logger) : _logger(std::move(logger)) {}
+
+		/**
+		 * @brief Unmaps the memory and closes both descriptors.
+		 */
+		~G13_SharedFramebuffer();
+
+		G13_SharedFramebuffer(const G13_SharedFramebuffer&) = delete;
+		G13_SharedFramebuffer& operator=(const G13_SharedFramebuffer&) = delete;
+
+		/**
+		 * @brief Creates, seals and maps the memory and creates the doorbell.
+		 * @param name memfd name, shown in /proc.
+		 * @return true when both are ready.
+		 */
+		bool open(const std::string& name);
+
+		int memory_fd() const { return _memory_fd; }
+		int doorbell_fd() const { return _doorbell_fd; }
+		size_t size() const { return sizeof(G13_SharedFrameLayout); }
+		uint64_t sequence() const { return _layout->sequence.load(std::memory_order_acquire); }
+
+		/**
+		 * @brief Clears the doorbell and gets the newest frame if it was not taken yet.
+		 * @param sequence receives the frame's sequence number, to be passed to shown().
+		 * @return the frame inside the shared memory, nullptr when there is no new frame.
+		 */
+		unsigned char* take_frame(uint64_t& sequence);
+
+		/**
+		 * @brief Tells clients a frame was pushed and its slot may be drawn into again.
+		 * @param sequence sequence number returned by take_frame.
+		 */
+		void shown(uint64_t sequence);
+
+		void dump(std::ostream& out) const;
+
+	private:
+		std::shared_ptr<G13_Log> _logger;
+		int _memory_fd = -1;
+		int _doorbell_fd = -1;
+		G13_SharedFrameLayout* _layout = nullptr;
+		uint64_t _taken = 0;
+		uint64_t _frames = 0;
+		// published frames replaced by a newer one before they were taken
+		uint64_t _coalesced = 0;
+	};
+}
+
+#endif //G13_G13_SHARED_FRAMEBUFFER_H
@@ -0,0 +1,67 @@
+#ifndef G13_G13_SPSC_QUEUE_H
+#define G13_G13_SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace G13 {
+	/**
+	 * @brief Bounded, lock-free single producer / single consumer queue.
+	 *
+	 * Used to hand work between a device's input thread and the worker thread
+	 * without taking a lock on the input path.
+	 */
+	template<class T, size_t CAPACITY>
+	class G13_SpscQueue {
+		static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+	public:
+		/**
+		 * @brief Appends an item. Only called from the producer thread.
+		 * @param item item to append.
+		 * @return false when the queue is full and the item was dropped.
+		 */
+		bool push(T item) {
+			const size_t tail = _tail.load(std::memory_order_relaxed);
+			if (tail - _head.load(std::memory_order_acquire) == CAPACITY) {
+				return false;
+			}
+			_items[tail & (CAPACITY - 1)] = std::move(item);
+			_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * @brief Removes the oldest item. Only called from the consumer thread.
+		 * @param item receives the removed item.
+		 * @return false when the queue is empty.
+		 */
+		bool pop(T& item) {
+			const size_t head = _head.load(std::memory_order_relaxed);
+			if (head == _tail.load(std::memory_order_acquire)) {
+				return false;
+			}
+			item = std::move(_items[head & (CAPACITY - 1)]);
+			_items[head & (CAPACITY - 1)] = T();
+			_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * @brief Counts the queued items. Exact for the producer, items only leave meanwhile.
+		 * @return number of queued items.
+		 */
+		size_t size() const {
+			return _tail.load(std::memory_order_relaxed) - _head.load(std::memory_order_acquire);
+		}
+
+	private:
+		std::array<T, CAPACITY> _items{};
+		alignas(64) std::atomic<size_t> _head{0};
+		alignas(64) std::atomic<size_t> _tail{0};
+	};
+}
+
+#endif //G13_G13_SPSC_QUEUE_H
@@ -2,6 +2,11 @@
  * This file contains code for managing keys and profiles
  */
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "g13.h"
 #include "g13_device.h"
 #include "g13_log.h"
 #include "g13_stick.h"
@@ -13,7 +18,9 @@ namespace G13 {
 			_logger(std::move(logger)),
 			_bounds(0, 0, 255, 255),
 			_center_pos(127, 127),
-			_north_pos(127, 0) {
+			_north_pos(127, 0),
+			_motion_velocity(0.0, 0.0),
+			_motion_remainder(0.0, 0.0) {
 		_stick_mode = STICK_KEYS;
 
 		auto add_zone = [this](const std::string& name, double x1, double y1, double x2, double y2) {
@@ -31,6 +38,8 @@ namespace G13 {
 		add_zone("RIGHT", 0.8, 0.0, 1.0, 1.0);
 		add_zone("PAGEUP", 0.0, 0.0, 1.0, 0.1);
 		add_zone("PAGEDOWN", 0.0, 0.9, 1.0, 1.0);
+
+		_recalc_calibrated();
 	}
 
 	G13_StickZone* G13_Stick::zone(const std::string& name, bool create) {
@@ -42,6 +51,7 @@ namespace G13 {
 
 		if (create) {
 			_zones.emplace_back(*this, name, G13_ZoneBounds(0.0, 0.0, 0.0, 0.0));
+			invalidate_zones();
 			return zone(name);
 		}
 		return 0;
@@ -50,6 +60,7 @@ namespace G13 {
 	void G13_Stick::set_mode(stick_mode_t m) {
 		if (m == _stick_mode)
 			return;
+		_reset_filter();
 		if (_stick_mode == STICK_CALCENTER || _stick_mode == STICK_CALBOUNDS || _stick_mode == STICK_CALNORTH) {
 			_recalc_calibrated();
 		}
@@ -61,12 +72,171 @@ namespace G13 {
 		}
 	}
 
+	void G13_Stick::_build_axis(int low, int center, int high, int32_t* table) {
+		const int32_t half = G13_STICK_ONE / 2;
+		for (int v = 0; v < static_cast<int>(G13_STICK_AXIS_VALUES); v++) {
+			// Each side of the center is scaled on its own, a side without any span stays centered
+			const int32_t span = v <= center ? center - low : high - center;
+			const int32_t d = span > 0 ? (v - center) * half / span : 0;
+			table[v] = std::clamp(d, -half, half);
+		}
+	}
+
 	void G13_Stick::_recalc_calibrated() {
+		_reset_filter();
+		const int64_t half = G13_STICK_ONE / 2;
+
+		int32_t axis_x[G13_STICK_AXIS_VALUES];
+		int32_t axis_y[G13_STICK_AXIS_VALUES];
+		_build_axis(_bounds.tl.x, _center_pos.x, _bounds.br.x, axis_x);
+		_build_axis(_bounds.tl.y, _center_pos.y, _bounds.br.y, axis_y);
+
+		// Rotate so the calibrated north points straight up, as Q14 fixed-point
+		const double angle = std::atan2(_north_pos.x - _center_pos.x, _center_pos.y - _north_pos.y);
+		const int64_t cos_q14 = std::lround(std::cos(angle) * (1 << 14));
+		const int64_t sin_q14 = std::lround(std::sin(angle) * (1 << 14));
+
+		const int64_t deadzone = std::llround(_deadzone * half);
+
+		_calibrated.resize(G13_STICK_AXIS_VALUES * G13_STICK_AXIS_VALUES);
+		for (size_t x = 0; x < G13_STICK_AXIS_VALUES; x++) {
+			for (size_t y = 0; y < G13_STICK_AXIS_VALUES; y++) {
+				int64_t rx = (axis_x[x] * cos_q14 + axis_y[y] * sin_q14) >> 14;
+				int64_t ry = (axis_y[y] * cos_q14 - axis_x[x] * sin_q14) >> 14;
+
+				if (deadzone > 0) {
+					// Radial deadzone, what is left outside of it is stretched back to full range
+					const int64_t radius = std::llround(std::sqrt(static_cast<double>(rx * rx + ry * ry)));
+					if (radius <= deadzone) {
+						rx = ry = 0;
+					} else {
+						const int64_t scaled = std::min((radius - deadzone) * half / (half - deadzone), half);
+						rx = rx * scaled / radius;
+						ry = ry * scaled / radius;
+					}
+				}
+
+				_calibrated[x << 8 | y] = G13_StickNormal{
+					static_cast<uint16_t>(std::clamp<int64_t>(rx + half, 0, G13_STICK_ONE)),
+					static_cast<uint16_t>(std::clamp<int64_t>(ry + half, 0, G13_STICK_ONE))
+				};
+			}
+		}
+
+		invalidate_zones();
+	}
+
+	void G13_Stick::set_deadzone(double deadzone) {
+		if (deadzone < 0.0 || deadzone >= 1.0) {
+			throw G13_CommandException("bad stick deadzone");
+		}
+		_deadzone = deadzone;
+		_recalc_calibrated();
 	}
 
-	void G13_Stick::remove_zone(const G13_StickZone& zone) {
+	void G13_Stick::remove_zone(G13_Device& keypad, const G13_StickZone& zone) {
 		G13_StickZone target(zone);
+		// Don't leave a key held down or a repeat running for a zone that is gone
+		if (target._active) {
+			target.leave(keypad);
+		}
 		_zones.erase(std::remove(_zones.begin(), _zones.end(), target), _zones.end());
+		invalidate_zones();
+	}
+
+	void G13_Stick::_rebuild_zone_lut() {
+		_zone_lut_dirty = false;
+		if (_zones.size() > G13_STICK_LUT_ZONES) {
+			_zone_lut.clear();
+			return;
+		}
+
+		_build_zone_lut(_zone_lut, &G13_StickZone::bounds);
+		if (std::ranges::any_of(_zones, [](const G13_StickZone& zone) { return zone.has_hysteresis(); })) {
+			_build_zone_lut(_zone_enter_lut, &G13_StickZone::enter_bounds);
+			_build_zone_lut(_zone_hold_lut, &G13_StickZone::hold_bounds);
+		} else {
+			_zone_enter_lut.clear();
+			_zone_hold_lut.clear();
+		}
+
+		// Zone indexes may have moved, carry the active state over from the zones
+		_active_zones = 0;
+		for (size_t i = 0; i < _zones.size(); i++) {
+			if (_zones[i]._active) {
+				_active_zones |= G13_ZoneMask(1) << i;
+			}
+		}
+	}
+
+	void G13_Stick::_build_zone_lut(std::vector<G13_ZoneMask>& lut, G13_ZoneBounds (G13_StickZone::*bounds_of)() const) const {
+		// Zone bounds in the fixed-point units of the calibrated positions
+		std::vector<G13_StickBounds> bounds;
+		std::vector<size_t> indexes;
+		for (size_t i = 0; i < _zones.size(); i++) {
+			// Zones without an action never activate
+			if (!_zones[i]._action) {
+				continue;
+			}
+			const G13_ZoneBounds zone_bounds = (_zones[i].*bounds_of)();
+			bounds.emplace_back(std::lround(zone_bounds.tl.x * G13_STICK_ONE), std::lround(zone_bounds.tl.y * G13_STICK_ONE),
+								std::lround(zone_bounds.br.x * G13_STICK_ONE), std::lround(zone_bounds.br.y * G13_STICK_ONE));
+			indexes.push_back(i);
+		}
+
+		lut.resize(G13_STICK_AXIS_VALUES * G13_STICK_AXIS_VALUES);
+		for (size_t raw = 0; raw < lut.size(); raw++) {
+			const G13_StickCoord pos(_calibrated[raw].x, _calibrated[raw].y);
+			G13_ZoneMask mask = 0;
+			for (size_t b = 0; b < bounds.size(); b++) {
+				if (bounds[b].contains(pos)) {
+					mask |= G13_ZoneMask(1) << indexes[b];
+				}
+			}
+			lut[raw] = mask;
+		}
+	}
+
+	void G13_Stick::set_filter(const std::string& name, const char* arguments) {
+		_filter_x = G13_AxisFilter::create(name, arguments);
+		_filter_y = G13_AxisFilter::create(name, arguments);
+	}
+
+	std::string G13_Stick::filter_description() const {
+		return _filter_x ? _filter_x->describe() : "none";
+	}
+
+	void G13_Stick::_reset_filter() {
+		if (_filter_x) {
+			_filter_x->reset();
+			_filter_y->reset();
+		}
+	}
+
+	G13_StickCoord G13_Stick::_filter(const G13_StickCoord& raw) {
+		const double time = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		const int x = static_cast<int>(std::lround(_filter_x->filter(raw.x, time)));
+		const int y = static_cast<int>(std::lround(_filter_y->filter(raw.y, time)));
+		return {std::clamp(x, 0, 0xff), std::clamp(y, 0, 0xff)};
+	}
+
+	void G13_Stick::_dispatch_zones(G13_Device& keypad, G13_ZoneMask mask) {
+		// Only zones that were entered or left emit, in zone order
+		G13_ZoneMask changed = mask ^ _active_zones;
+		_active_zones = mask;
+		if (changed) {
+			_zone_stats.transitions.fetch_add(std::popcount(changed), std::memory_order_relaxed);
+		}
+		while (changed) {
+			const int index = std::countr_zero(changed);
+			changed &= changed - 1;
+			G13_StickZone& zone = _zones[index];
+			if (mask >> index & 1) {
+				zone.enter(keypad);
+			} else {
+				zone.leave(keypad);
+			}
+		}
 	}
 
 	void G13_Stick::dump(std::ostream& out) const {
@@ -77,41 +247,23 @@ namespace G13 {
 	}
 
 	G13_StickCoord G13_Stick::getCurrentPos() {
-		return _current_pos;
+		const uint16_t pos = _published_pos.load(std::memory_order_relaxed);
+		return {pos >> 8, pos & 0xff};
 	}
 
 	double G13_Stick::getDX() {
-		double dx = 0.5;
-		if (_current_pos.x <= _center_pos.x) {
-			dx = _current_pos.x - _bounds.tl.x;
-			dx /= (_center_pos.x - _bounds.tl.x) * 2;
-		} else {
-			dx = _bounds.br.x - _current_pos.x;
-			dx /= (_bounds.br.x - _center_pos.x) * 2;
-			dx = 1.0 - dx;
-		}
-
-		return dx;
+		return static_cast<double>(_published_normal.load(std::memory_order_relaxed) >> 16) / G13_STICK_ONE;
 	}
 
 	double G13_Stick::getDY() {
-		double dy = 0.5;
-		if (_current_pos.y <= _center_pos.y) {
-			dy = _current_pos.y - _bounds.tl.y;
-			dy /= (_center_pos.y - _bounds.tl.y) * 2;
-		} else {
-			dy = _bounds.br.y - _current_pos.y;
-			dy /= (_bounds.br.y - _center_pos.y) * 2;
-			dy = 1.0 - dy;
-		}
-
-		return dy;
+		return static_cast<double>(_published_normal.load(std::memory_order_relaxed) & 0xffff) / G13_STICK_ONE;
 	}
 
 	void G13_Stick::parse_joystick(G13_Device& keypad, unsigned char* buf) {
 
 		_current_pos.x = buf[1];
 		_current_pos.y = buf[2];
+		_published_pos.store(buf[1] << 8 | buf[2], std::memory_order_relaxed);
 
 		// update targets if we're in calibration mode
 		switch (_stick_mode) {
@@ -126,25 +278,127 @@ namespace G13 {
 				return;
 		};
 
-		// determine our normalized position
-		double dx = getDX();
-		double dy = getDY();
+		// determine our calibrated position once, everything below reuses it
+		const size_t unfiltered_raw = _current_pos.x << 8 | _current_pos.y;
+		size_t raw = unfiltered_raw;
+		if (_filter_x) {
+			const G13_StickCoord filtered = _filter(_current_pos);
+			raw = filtered.x << 8 | filtered.y;
+		}
+		_normal = _calibrated[raw];
+		_published_normal.store(_normal.x << 16 | _normal.y, std::memory_order_relaxed);
 
-		_logger->trace(std::format("x={} y={} dx={} dy={}", std::to_string(_current_pos.x), std::to_string(_current_pos.y), std::to_string(dx), std::to_string(dy)));
-		G13_ZoneCoord jpos(dx, dy);
+		G13_LOG_TRACE(_logger, std::format("x={} y={} dx={:f} dy={:f}", _current_pos.x, _current_pos.y, getDX(), getDY()));
 		if (_stick_mode == STICK_ABSOLUTE) {
-			keypad.send_event(EV_ABS, ABS_X, _current_pos.x);
-			keypad.send_event(EV_ABS, ABS_Y, _current_pos.y);
+			keypad.send_event(EV_ABS, ABS_X, _normal.x * 0xff / G13_STICK_ONE);
+			keypad.send_event(EV_ABS, ABS_Y, _normal.y * 0xff / G13_STICK_ONE);
 		} else if (_stick_mode == STICK_KEYS) {
-			for (auto& zone : _zones) {
-				zone.test(keypad, jpos);
+			if (_zone_lut_dirty) {
+				_rebuild_zone_lut();
 			}
+			if (!_zone_lut.empty()) {
+				G13_ZoneMask mask = _zone_lut[raw];
+				if (!_zone_hold_lut.empty()) {
+					// Active zones stay active until the stick leaves their wider hold bounds
+					mask = _zone_enter_lut[raw] | (_zone_hold_lut[raw] & _active_zones);
+				}
+				// What the zones would have done without filter and hysteresis
+				const G13_ZoneMask unfiltered = _zone_lut[unfiltered_raw];
+				if (const G13_ZoneMask changed = unfiltered ^ _unfiltered_zones) {
+					_zone_stats.unfiltered_transitions.fetch_add(std::popcount(changed), std::memory_order_relaxed);
+				}
+				_unfiltered_zones = unfiltered;
+				_dispatch_zones(keypad, mask);
+			} else {
+				G13_ZoneCoord jpos(static_cast<double>(_normal.x) / G13_STICK_ONE, static_cast<double>(_normal.y) / G13_STICK_ONE);
+				for (auto& zone : _zones) {
+					zone.test(keypad, jpos);
+				}
+			}
+		} else if (_stick_mode == STICK_RELATIVE || _stick_mode == STICK_SCROLL) {
+			_update_motion(keypad);
+		}
+	}
+
+	void G13_Stick::set_motion_option(const std::string& option, double value) {
+		if (option == "deadzone" && value >= 0.0 && value < 1.0) {
+			_motion.deadzone = value;
+		} else if (option == "curve" && value > 0.0) {
+			_motion.curve = value;
+		} else if (option == "speed" && value > 0.0) {
+			_motion.speed = value;
+		} else if (option == "scroll_speed" && value > 0.0) {
+			_motion.scroll_speed = value;
+		} else if (option == "rate" && value >= 1.0 && value <= 1000.0) {
+			_motion.rate = static_cast<int>(value);
+		} else {
+			throw G13_CommandException("bad stick motion option : " + option);
+		}
+	}
+
+	void G13_Stick::_update_motion(G13_Device& keypad) {
+		// Deflection from the center, -1.0 - 1.0 per axis
+		const double x = (_normal.x * 2.0 - G13_STICK_ONE) / G13_STICK_ONE;
+		const double y = (_normal.y * 2.0 - G13_STICK_ONE) / G13_STICK_ONE;
+		const double deflection = std::hypot(x, y);
+
+		if (deflection <= _motion.deadzone) {
+			_stop_motion(keypad);
+			return;
+		}
+
+		// Scale what is outside the deadzone back to 0.0 - 1.0, then shape it with the curve
+		const double scaled = std::pow(std::min((deflection - _motion.deadzone) / (1.0 - _motion.deadzone), 1.0), _motion.curve);
+		_motion_velocity = G13_ZoneCoord(x / deflection * scaled, y / deflection * scaled);
+
+		if (_motion_timer == G13_TimerWheel::NO_TIMER) {
+			const std::chrono::milliseconds interval(std::max(1000 / _motion.rate, 1));
+			// Move right away instead of waiting a full interval for the first event
+			_motion_last = std::chrono::steady_clock::now() - interval;
+			_emit_motion(keypad);
+			_motion_timer = keypad.schedule_timer(interval, [this, &keypad] {
+				_emit_motion(keypad);
+			}, interval);
+		}
+	}
+
+	void G13_Stick::_emit_motion(G13_Device& keypad) {
+		if (_stick_mode != STICK_RELATIVE && _stick_mode != STICK_SCROLL) {
+			_stop_motion(keypad);
+			return;
+		}
+
+		const auto now = std::chrono::steady_clock::now();
+		const double elapsed = std::chrono::duration<double>(now - _motion_last).count();
+		_motion_last = now;
+
+		const double speed = _stick_mode == STICK_SCROLL ? _motion.scroll_speed : _motion.speed;
+		_motion_remainder.x += _motion_velocity.x * speed * elapsed;
+		_motion_remainder.y += _motion_velocity.y * speed * elapsed;
+
+		// Only whole units can be sent, keep the fraction for the next emission
+		const int move_x = static_cast<int>(_motion_remainder.x);
+		const int move_y = static_cast<int>(_motion_remainder.y);
+		_motion_remainder.x -= move_x;
+		_motion_remainder.y -= move_y;
+
+		if (_stick_mode == STICK_SCROLL) {
+			// Pushing the stick up scrolls up, which is a positive wheel value
+			if (move_x) keypad.send_event(EV_REL, REL_HWHEEL, move_x);
+			if (move_y) keypad.send_event(EV_REL, REL_WHEEL, -move_y);
 		} else {
-			/*    send_event(g13->uinput_file, EV_REL, REL_X, stick_x/16 - 8);
-			 send_event(g13->uinput_file, EV_REL, REL_Y, stick_y/16 - 8);*/
+			if (move_x) keypad.send_event(EV_REL, REL_X, move_x);
+			if (move_y) keypad.send_event(EV_REL, REL_Y, move_y);
 		}
 	}
 
+	void G13_Stick::_stop_motion(G13_Device& keypad) {
+		keypad.cancel_timer(_motion_timer);
+		_motion_timer = G13_TimerWheel::NO_TIMER;
+		_motion_velocity = G13_ZoneCoord(0.0, 0.0);
+		_motion_remainder = G13_ZoneCoord(0.0, 0.0);
+	}
+
 	//**************************************************************************
 
 	void G13_StickZone::dump(std::ostream& out) const {
@@ -154,23 +408,80 @@ namespace G13 {
 		} else {
 			out << " (no action)";
 		}
+		if (has_hysteresis()) {
+			out << "  hysteresis " << _enter_margin << "/" << _exit_margin;
+		}
+		if (_repeat_interval > std::chrono::milliseconds::zero()) {
+			out << "  repeat " << _repeat_delay.count() << "ms/" << _repeat_interval.count() << "ms";
+		}
 	}
 
 	void G13_StickZone::test(G13_Device& keypad, const G13_ZoneCoord& loc) {
 		if (!_action) return;
-		bool prior_active = _active;
-		_active = _bounds.contains(loc);
-		if (!_active) {
-			if (prior_active) {
-				// cout << "exit stick zone " << _name << std::endl;
-				_action->act(false, keypad);
-			}
-		} else {
-			// cout << "in stick zone " << _name << std::endl;
-			_action->act(true, keypad);
+		const bool active = (_active ? hold_bounds() : enter_bounds()).contains(loc);
+		if (active && !_active) {
+			enter(keypad);
+		} else if (!active && _active) {
+			leave(keypad);
 		}
 	}
 
+	void G13_StickZone::enter(G13_Device& keypad) {
+		_active = true;
+		keypad.dispatch(_action, true);
+		if (_repeat_interval > std::chrono::milliseconds::zero()) {
+			// The zone may move in the zone list, find it again by name when the timer fires
+			_repeat_timer = keypad.schedule_timer(_repeat_delay, [&keypad, &stick = parent(), name = _name] {
+				if (G13_StickZone* zone = stick.zone(name)) {
+					zone->repeat(keypad);
+				}
+			}, _repeat_interval);
+		}
+	}
+
+	void G13_StickZone::leave(G13_Device& keypad) {
+		_active = false;
+		keypad.cancel_timer(_repeat_timer);
+		_repeat_timer = G13_TimerWheel::NO_TIMER;
+		keypad.dispatch(_action, false);
+	}
+
+	void G13_StickZone::repeat(G13_Device& keypad) {
+		keypad.dispatch(_action, false);
+		keypad.dispatch(_action, true);
+	}
+
+	void G13_StickZone::set_repeat(std::chrono::milliseconds delay, std::chrono::milliseconds interval) {
+		_repeat_delay = delay;
+		_repeat_interval = interval;
+	}
+
+	void G13_StickZone::set_hysteresis(double enter_margin, double exit_margin) {
+		_enter_margin = enter_margin;
+		_exit_margin = exit_margin;
+		parent().invalidate_zones();
+	}
+
+	G13_ZoneBounds G13_StickZone::enter_bounds() const {
+		return G13_ZoneBounds(_bounds.tl.x + _enter_margin, _bounds.tl.y + _enter_margin,
+							  _bounds.br.x - _enter_margin, _bounds.br.y - _enter_margin);
+	}
+
+	G13_ZoneBounds G13_StickZone::hold_bounds() const {
+		return G13_ZoneBounds(_bounds.tl.x - _exit_margin, _bounds.tl.y - _exit_margin,
+							  _bounds.br.x + _exit_margin, _bounds.br.y + _exit_margin);
+	}
+
+	void G13_StickZone::set_bounds(const G13_ZoneBounds& bounds) {
+		_bounds = bounds;
+		parent().invalidate_zones();
+	}
+
+	void G13_StickZone::set_action(const G13_ActionPtr& action) {
+		G13_Actionable<G13_Stick>::set_action(action);
+		parent().invalidate_zones();
+	}
+
 	G13_StickZone::G13_StickZone(G13_Stick& stick, const std::string& name, const G13_ZoneBounds& b,
 								 G13_ActionPtr action) :
 			G13_Actionable<G13_Stick>(stick, name), _bounds(b), _active(false) {
@@ -5,12 +5,17 @@
 #ifndef G13_G13_STICK_H
 #define G13_G13_STICK_H
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "helper.h"
 #include "g13_action.h"
+#include "g13_stick_filter.h"
+#include "g13_timer_wheel.h"
 
 namespace G13 {
 	typedef Helper::Coord<int> G13_StickCoord;
@@ -18,7 +23,39 @@ namespace G13 {
 	typedef Helper::Coord<double> G13_ZoneCoord;
 	typedef Helper::Bounds<double> G13_ZoneBounds;
 
-	enum stick_mode_t { STICK_ABSOLUTE, STICK_RELATIVE, STICK_KEYS, STICK_CALCENTER, STICK_CALBOUNDS, STICK_CALNORTH };
+	enum stick_mode_t { STICK_ABSOLUTE, STICK_RELATIVE, STICK_KEYS, STICK_CALCENTER, STICK_CALBOUNDS, STICK_CALNORTH, STICK_SCROLL };
+
+	/*!
+	 * tuning of the RELATIVE (pointer) and SCROLL (wheel) stick modes
+	 */
+	struct G13_StickMotion {
+		// radial deflection (0.0 - 1.0) ignored around the center
+		double deadzone = 0.15;
+		// exponent applied to the deflection outside the deadzone, 1 is linear
+		double curve = 2.0;
+		// pointer speed in pixels per second at full deflection
+		double speed = 1200.0;
+		// wheel speed in clicks per second at full deflection
+		double scroll_speed = 20.0;
+		// motion events per second, independent of the USB report rate
+		int rate = 250;
+	};
+
+	// bit N is set for the N-th stick zone
+	typedef uint32_t G13_ZoneMask;
+	// zones the lookup table can track, more zones fall back to testing every zone
+	const size_t G13_STICK_LUT_ZONES = 32;
+	const size_t G13_STICK_AXIS_VALUES = 256;
+	// fixed-point 1.0 of calibrated stick positions
+	const int G13_STICK_ONE = 4096;
+
+	/*!
+	 * calibrated stick position, each axis from 0 (top/left) to G13_STICK_ONE (bottom/right)
+	 */
+	struct G13_StickNormal {
+		uint16_t x;
+		uint16_t y;
+	};
 
 	class G13_Stick;
 	class G13_Device;
@@ -34,13 +71,61 @@ namespace G13 {
 
 		void parse_key(unsigned char* byte, G13_Device* g13);
 		void test(G13_Device& keypad, const G13_ZoneCoord& loc);
-		void set_bounds(const G13_ZoneBounds& bounds) { _bounds = bounds; }
+		void set_bounds(const G13_ZoneBounds& bounds);
+		G13_ZoneBounds bounds() const { return _bounds; }
+		void set_action(const G13_ActionPtr& action) override;
+
+		/*!
+		 * sets the hysteresis margins (0.0 - 1.0): the stick has to get enter_margin inside the bounds to
+		 * enter the zone and exit_margin outside of them to leave it again
+		 */
+		void set_hysteresis(double enter_margin, double exit_margin);
+		bool has_hysteresis() const { return _enter_margin > 0.0 || _exit_margin > 0.0; }
+
+		/*!
+		 * bounds the stick has to reach to enter the zone
+		 */
+		G13_ZoneBounds enter_bounds() const;
+
+		/*!
+		 * bounds the stick has to leave to exit the zone
+		 */
+		G13_ZoneBounds hold_bounds() const;
+
+		/*!
+		 * repeats the zone's action while the stick stays in the zone, a zero interval disables repeating
+		 */
+		void set_repeat(std::chrono::milliseconds delay, std::chrono::milliseconds interval);
+
+		/*!
+		 * runs the action for entering the zone and starts repeating it if configured
+		 */
+		void enter(G13_Device& keypad);
+
+		/*!
+		 * stops repeating and runs the action for leaving the zone
+		 */
+		void leave(G13_Device& keypad);
 
 	protected:
+		// G13_Stick evaluates the zones through its lookup table
+		friend class G13_Stick;
+
+		/*!
+		 * runs a release and a press of the action, so every repeat is a separate key press
+		 */
+		void repeat(G13_Device& keypad);
 
 		bool _active;
 
 		G13_ZoneBounds _bounds;
+
+		double _enter_margin = 0.0;
+		double _exit_margin = 0.0;
+
+		std::chrono::milliseconds _repeat_delay{0};
+		std::chrono::milliseconds _repeat_interval{0};
+		G13_TimerWheel::TimerId _repeat_timer = G13_TimerWheel::NO_TIMER;
 	};
 
 // *************************************************************************
@@ -53,20 +138,107 @@ namespace G13 {
 
 		void set_mode(stick_mode_t);
 		G13_StickZone* zone(const std::string&, bool create = false);
-		void remove_zone(const G13_StickZone& zone);
+		void remove_zone(G13_Device& keypad, const G13_StickZone& zone);
 
 		const std::vector<G13_StickZone>& zones() const { return _zones; }
 
+		/*!
+		 * marks the zone lookup table stale after zones, their bounds or the calibration changed
+		 */
+		void invalidate_zones() { _zone_lut_dirty = true; }
+
 		void dump(std::ostream&) const;
 
+		/*!
+		 * sets the radial deadzone (0.0 - 1.0) around the calibrated center, positions inside it read as the center
+		 */
+		void set_deadzone(double deadzone);
+		double deadzone() const { return _deadzone; }
+
+		/*!
+		 * sets the filter smoothing raw positions, see G13_AxisFilter::create
+		 */
+		void set_filter(const std::string& name, const char* arguments);
+
+		/*!
+		 * describes the filter and its parameters, "none" without one
+		 */
+		std::string filter_description() const;
+
+		/*!
+		 * counts zone transitions, and how many more there would have been without filter and hysteresis
+		 */
+		struct ZoneStats {
+			std::atomic<uint64_t> transitions{0};
+			std::atomic<uint64_t> unfiltered_transitions{0};
+		};
+		const ZoneStats& zone_stats() const { return _zone_stats; }
+
+		/*!
+		 * changes one option of the RELATIVE/SCROLL modes, see G13_StickMotion
+		 */
+		void set_motion_option(const std::string& option, double value);
+		const G13_StickMotion& motion() const { return _motion; }
+
 		G13_StickCoord getCurrentPos();
 		double getDX();
 		double getDY();
 
 	protected:
 
+		/*!
+		 * rebuilds the table mapping raw stick positions to calibrated ones from the bounds,
+		 * center, north and deadzone
+		 */
 		void _recalc_calibrated();
 
+		/*!
+		 * fills table with the fixed-point deflection from center (-G13_STICK_ONE / 2 - G13_STICK_ONE / 2)
+		 * of every raw axis value
+		 */
+		static void _build_axis(int low, int center, int high, int32_t* table);
+
+		/*!
+		 * rebuilds the table mapping every raw stick position to the zones containing it
+		 */
+		void _rebuild_zone_lut();
+
+		/*!
+		 * presses the zones in mask and releases the previously active zones that are not
+		 */
+		void _dispatch_zones(G13_Device& keypad, G13_ZoneMask mask);
+
+		/*!
+		 * runs the raw position through the filter
+		 * @return filtered raw position
+		 */
+		G13_StickCoord _filter(const G13_StickCoord& raw);
+
+		/*!
+		 * forgets the filter history, positions filtered under the old mode or calibration would leak into the new one
+		 */
+		void _reset_filter();
+
+		/*!
+		 * builds a zone lookup table from the given bounds of every zone
+		 */
+		void _build_zone_lut(std::vector<G13_ZoneMask>& lut, G13_ZoneBounds (G13_StickZone::*bounds_of)() const) const;
+
+		/*!
+		 * updates the pointer/wheel velocity from the stick and starts or stops the motion timer
+		 */
+		void _update_motion(G13_Device& keypad);
+
+		/*!
+		 * emits the motion accumulated since the last call as relative events
+		 */
+		void _emit_motion(G13_Device& keypad);
+
+		/*!
+		 * stops the motion timer and drops any accumulated sub-pixel motion
+		 */
+		void _stop_motion(G13_Device& keypad);
+
 		std::shared_ptr<G13_Log> _logger;
 		std::vector<G13_StickZone> _zones;
 
@@ -75,8 +247,40 @@ namespace G13 {
 		G13_StickCoord _north_pos;
 
 		G13_StickCoord _current_pos;
+		// last position packed as x << 8 | y, readable from the worker while the input thread writes it
+		std::atomic<uint16_t> _published_pos{127 << 8 | 127};
+
+		// calibrated position of every raw position, indexed by x << 8 | y
+		std::vector<G13_StickNormal> _calibrated;
+		// calibrated position of the last report
+		G13_StickNormal _normal{G13_STICK_ONE / 2, G13_STICK_ONE / 2};
+		// _normal packed as x << 16 | y for the worker
+		std::atomic<uint32_t> _published_normal{G13_STICK_ONE / 2 << 16 | G13_STICK_ONE / 2};
+		double _deadzone = 0.0;
 
 		stick_mode_t _stick_mode;
+
+		// indexed by x << 8 | y
+		std::vector<G13_ZoneMask> _zone_lut;
+		// used instead of _zone_lut while any zone has hysteresis
+		std::vector<G13_ZoneMask> _zone_enter_lut;
+		std::vector<G13_ZoneMask> _zone_hold_lut;
+		G13_ZoneMask _active_zones = 0;
+		bool _zone_lut_dirty = true;
+
+		std::unique_ptr<G13_AxisFilter> _filter_x;
+		std::unique_ptr<G13_AxisFilter> _filter_y;
+		// zones the unfiltered position is in, to count suppressed transitions
+		G13_ZoneMask _unfiltered_zones = 0;
+		ZoneStats _zone_stats;
+
+		G13_StickMotion _motion;
+		// -1.0 - 1.0 per axis after deadzone and curve
+		G13_ZoneCoord _motion_velocity;
+		// motion smaller than one event unit, carried over to the next emission
+		G13_ZoneCoord _motion_remainder;
+		std::chrono::steady_clock::time_point _motion_last;
+		G13_TimerWheel::TimerId _motion_timer = G13_TimerWheel::NO_TIMER;
 	};
 }
 
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <format>
+#include <numbers>
+
+#include "g13.h"
+#include "g13_stick_filter.h"
+
+namespace G13 {
+	std::unique_ptr<G13_AxisFilter> G13_AxisFilter::create(const std::string& name, const char* arguments) {
+		if (name == "none") {
+			return nullptr;
+		}
+		if (name == "median3") {
+			return std::make_unique<G13_Median3Filter>();
+		}
+		if (name == "ema") {
+			double alpha;
+			if (sscanf(arguments, "%lf", &alpha) != 1 || alpha <= 0.0 || alpha > 1.0) {
+				throw G13_CommandException("ema needs an alpha between 0.0 and 1.0");
+			}
+			return std::make_unique<G13_EmaFilter>(alpha);
+		}
+		if (name == "oneeuro") {
+			double min_cutoff, beta;
+			if (sscanf(arguments, "%lf %lf", &min_cutoff, &beta) != 2 || min_cutoff <= 0.0 || beta < 0.0) {
+				throw G13_CommandException("oneeuro needs a min_cutoff above 0 and a beta of at least 0");
+			}
+			return std::make_unique<G13_OneEuroFilter>(min_cutoff, beta);
+		}
+		throw G13_CommandException("unknown stick filter : " + name);
+	}
+
+	double G13_Median3Filter::filter(double value, double time) {
+		_history[_next] = value;
+		_next = (_next + 1) % 3;
+		if (_count < 3) {
+			_count++;
+		}
+		if (_count < 3) {
+			return value;
+		}
+
+		const double a = _history[0], b = _history[1], c = _history[2];
+		return std::max(std::min(a, b), std::min(std::max(a, b), c));
+	}
+
+	double G13_EmaFilter::filter(double value, double time) {
+		if (!_primed) {
+			_value = value;
+			_primed = true;
+		} else {
+			_value += _alpha * (value - _value);
+		}
+		return _value;
+	}
+
+	std::string G13_EmaFilter::describe() const {
+		return std::format("ema {}", _alpha);
+	}
+
+	double G13_OneEuroFilter::smoothing(double cutoff, double elapsed) {
+		const double tau = 1.0 / (2.0 * std::numbers::pi * cutoff);
+		return 1.0 / (1.0 + tau / elapsed);
+	}
+
+	double G13_OneEuroFilter::filter(double value, double time) {
+		if (!_primed || time <= _time) {
+			// Without elapsed time there is no speed to adapt to
+			if (!_primed) {
+				_value = value;
+				_derivative = 0.0;
+				_time = time;
+				_primed = true;
+			}
+			return _value;
+		}
+
+		const double elapsed = time - _time;
+		_time = time;
+
+		// Smooth the speed, then let it open up the cutoff of the value
+		const double derivative = (value - _value) / elapsed;
+		_derivative += smoothing(_derivative_cutoff, elapsed) * (derivative - _derivative);
+		const double cutoff = _min_cutoff + _beta * std::abs(_derivative);
+		_value += smoothing(cutoff, elapsed) * (value - _value);
+		return _value;
+	}
+
+	std::string G13_OneEuroFilter::describe() const {
+		return std::format("oneeuro {} {}", _min_cutoff, _beta);
+	}
+}
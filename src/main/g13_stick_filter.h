@@ -0,0 +1,100 @@
+#ifndef G13_G13_STICK_FILTER_H
+#define G13_G13_STICK_FILTER_H
+
+#include <memory>
+#include <string>
+
+namespace G13 {
+	/*!
+	 * Smooths one axis of the raw stick position before it is calibrated
+	 */
+	class G13_AxisFilter {
+	public:
+		virtual ~G13_AxisFilter() = default;
+
+		/*!
+		 * filters the next raw value of the axis
+		 * @param value raw axis value
+		 * @param time report time in seconds, only differences matter
+		 * @return filtered value
+		 */
+		virtual double filter(double value, double time) = 0;
+
+		/*!
+		 * forgets the history, the next value passes unfiltered
+		 */
+		virtual void reset() = 0;
+
+		/*!
+		 * creates a filter from its stickfilter description
+		 * @param name none, median3, ema or oneeuro
+		 * @param arguments filter parameters: alpha for ema, min_cutoff and beta for oneeuro
+		 * @return new filter, nullptr for none
+		 * @throws G13_CommandException for unknown filters or bad parameters
+		 */
+		static std::unique_ptr<G13_AxisFilter> create(const std::string& name, const char* arguments);
+
+		/*!
+		 * describes the filter and its parameters
+		 */
+		virtual std::string describe() const = 0;
+	};
+
+	/*!
+	 * median of the last three values, removes single-report spikes without lag on steady motion
+	 */
+	class G13_Median3Filter : public G13_AxisFilter {
+	public:
+		double filter(double value, double time) override;
+		void reset() override { _count = 0; }
+		std::string describe() const override { return "median3"; }
+
+	private:
+		double _history[3] = {};
+		int _count = 0;
+		int _next = 0;
+	};
+
+	/*!
+	 * exponential moving average, alpha is the weight of the newest value
+	 */
+	class G13_EmaFilter : public G13_AxisFilter {
+	public:
+		explicit G13_EmaFilter(double alpha) : _alpha(alpha) {}
+
+		double filter(double value, double time) override;
+		void reset() override { _primed = false; }
+		std::string describe() const override;
+
+	private:
+		double _alpha;
+		double _value = 0.0;
+		bool _primed = false;
+	};
+
+	/*!
+	 * One Euro filter (Casiez et al.): heavy smoothing while the stick rests, little lag while it moves fast
+	 */
+	class G13_OneEuroFilter : public G13_AxisFilter {
+	public:
+		G13_OneEuroFilter(double min_cutoff, double beta, double derivative_cutoff = 1.0) :
+				_min_cutoff(min_cutoff), _beta(beta), _derivative_cutoff(derivative_cutoff) {}
+
+		double filter(double value, double time) override;
+		void reset() override { _primed = false; }
+		std::string describe() const override;
+
+	private:
+		static double smoothing(double cutoff, double elapsed);
+
+		double _min_cutoff;
+		double _beta;
+		double _derivative_cutoff;
+		double _value = 0.0;
+		double _derivative = 0.0;
+		double _time = 0.0;
+		bool _primed = false;
+	};
+}
+
+#endif //G13_G13_STICK_FILTER_H
@@ -0,0 +1,143 @@
+#include <algorithm>
+
+#include "g13_timer_wheel.h"
+
+namespace G13 {
+	G13_TimerWheel::G13_TimerWheel() : _origin(Clock::now()) {
+		for (auto& slot : _slots) {
+			slot.reserve(G13_TIMER_WHEEL_SLOT_CAPACITY);
+		}
+	}
+
+	uint64_t G13_TimerWheel::to_tick(Clock::time_point when) const {
+		if (when <= _origin) {
+			return 0;
+		}
+		// Round up, a timer never fires before its time
+		return std::chrono::ceil<std::chrono::milliseconds>(when - _origin).count();
+	}
+
+	G13_TimerWheel::Clock::time_point G13_TimerWheel::to_time(uint64_t tick) const {
+		return _origin + std::chrono::milliseconds(tick);
+	}
+
+	G13_TimerWheel::TimerId G13_TimerWheel::schedule(Clock::time_point when, TIMER_CALLBACK callback,
+													 std::chrono::milliseconds interval) {
+		const TimerId id = _next_id++;
+		insert({id, to_tick(when), interval, std::move(callback)});
+		return id;
+	}
+
+	G13_TimerWheel::TickTable::iterator G13_TimerWheel::find_tick(TimerId id) {
+		return std::ranges::lower_bound(_ticks, id, {}, &TickTable::value_type::first);
+	}
+
+	void G13_TimerWheel::insert(Timer timer) {
+		// Ticks that were already expired are picked up by the next expire()
+		timer.tick = std::max(timer.tick, _current_tick + 1);
+		// New ids are the largest, the table stays sorted
+		_ticks.emplace_back(timer.id, timer.tick);
+		_next_tick = std::min(_next_tick, timer.tick);
+		_slots[timer.tick % G13_TIMER_WHEEL_SLOTS].push_back(std::move(timer));
+	}
+
+	bool G13_TimerWheel::cancel(TimerId id) {
+		const auto found = find_tick(id);
+		if (found == _ticks.end() || found->first != id) {
+			return false;
+		}
+
+		auto& slot = _slots[found->second % G13_TIMER_WHEEL_SLOTS];
+		std::erase_if(slot, [id](const Timer& timer) { return timer.id == id; });
+		// Only losing the earliest timer makes the cached expiry stale
+		if (found->second == _next_tick) {
+			_next_tick_valid = false;
+		}
+		_ticks.erase(found);
+		return true;
+	}
+
+	void G13_TimerWheel::expire(Clock::time_point now) {
+		const uint64_t now_tick = now < _origin ? 0 : std::chrono::floor<std::chrono::milliseconds>(now - _origin).count();
+		if (now_tick <= _current_tick) {
+			return;
+		}
+
+		// A full turn visits every slot, more ticks than that cannot find anything new
+		const uint64_t ticks = std::min<uint64_t>(now_tick - _current_tick, G13_TIMER_WHEEL_SLOTS);
+		auto& due = _due;
+		for (uint64_t tick = _current_tick + 1; tick <= _current_tick + ticks; tick++) {
+			auto& slot = _slots[tick % G13_TIMER_WHEEL_SLOTS];
+			for (auto it = slot.begin(); it != slot.end();) {
+				if (it->tick <= now_tick) {
+					due.push_back(std::move(*it));
+					it = slot.erase(it);
+				} else {
+					++it;
+				}
+			}
+		}
+		_current_tick = now_tick;
+		// Rescheduled and new timers lower it again while the callbacks run
+		_next_tick = UINT64_MAX;
+		_next_tick_valid = false;
+
+		std::ranges::sort(due, [](const Timer& a, const Timer& b) {
+			return a.tick != b.tick ? a.tick < b.tick : a.id < b.id;
+		});
+		for (auto& timer : due) {
+			// An earlier callback may have cancelled this one
+			const auto found = find_tick(timer.id);
+			if (found == _ticks.end() || found->first != timer.id) {
+				continue;
+			}
+			if (timer.interval <= std::chrono::milliseconds::zero()) {
+				_ticks.erase(found);
+				timer.callback();
+				continue;
+			}
+
+			// Keep the id pending so the callback can still cancel the repeating timer, then move
+			// the callback into its next period instead of copying it
+			timer.tick = std::max(timer.tick + timer.interval.count(), _current_tick + 1);
+			found->second = timer.tick;
+			timer.callback();
+			const auto pending = find_tick(timer.id);
+			if (pending != _ticks.end() && pending->first == timer.id) {
+				_next_tick = std::min(_next_tick, timer.tick);
+				_slots[timer.tick % G13_TIMER_WHEEL_SLOTS].push_back(std::move(timer));
+			}
+		}
+		due.clear();
+	}
+
+	G13_TimerWheel::Clock::time_point G13_TimerWheel::next_expiry() const {
+		if (_ticks.empty()) {
+			return Clock::time_point::max();
+		}
+		if (_next_tick_valid) {
+			return to_time(_next_tick);
+		}
+
+		// The first slot holding a timer for its own tick has the earliest one
+		_next_tick = UINT64_MAX;
+		for (uint64_t tick = _current_tick + 1; tick <= _current_tick + G13_TIMER_WHEEL_SLOTS; tick++) {
+			for (const Timer& timer : _slots[tick % G13_TIMER_WHEEL_SLOTS]) {
+				if (timer.tick == tick) {
+					_next_tick = tick;
+				}
+			}
+			if (_next_tick != UINT64_MAX) {
+				break;
+			}
+		}
+		// Everything is more than a turn away
+		if (_next_tick == UINT64_MAX) {
+			for (const auto& [id, tick] : _ticks) {
+				_next_tick = std::min(_next_tick, tick);
+			}
+		}
+		_next_tick_valid = true;
+		return to_time(_next_tick);
+	}
+}
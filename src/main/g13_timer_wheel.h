@@ -0,0 +1,107 @@
+#ifndef G13_G13_TIMER_WHEEL_H
+#define G13_G13_TIMER_WHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace G13 {
+	const size_t G13_TIMER_WHEEL_SLOTS = 256;
+	// timers every slot has room for up front, so scheduling into a slot for the first time doesn't allocate
+	const size_t G13_TIMER_WHEEL_SLOT_CAPACITY = 4;
+
+	/**
+	 * @brief Hashed timing wheel with millisecond ticks.
+	 *
+	 * Timers land in the slot of their expiry tick modulo the wheel size, so expiring only
+	 * visits the slots of the elapsed ticks. Pending ids are kept in a vector sorted by id to
+	 * find a timer on cancel: scheduling appends in constant time, cancelling and expiring a
+	 * timer search in logarithmic and erase in linear time of the pending timers, without
+	 * allocating once the vector has grown. next_expiry() is cached; after the earliest timer
+	 * was cancelled or expired it scans forward from the current tick, and only timers more
+	 * than a wheel turn away make it look at every pending timer. The wheel does not own a
+	 * clock or a timerfd: the owner calls expire() whenever next_expiry() has passed. All
+	 * calls must come from the same thread.
+	 */
+	class G13_TimerWheel {
+	public:
+		typedef std::chrono::steady_clock Clock;
+		typedef std::function<void()> TIMER_CALLBACK;
+		typedef uint64_t TimerId;
+
+		/**
+		 * @brief Id that is never handed out, usable as "no timer".
+		 */
+		static constexpr TimerId NO_TIMER = 0;
+
+		G13_TimerWheel();
+
+		/**
+		 * @brief Schedules a callback.
+		 * @param when time the callback should run at; past times run on the next expire().
+		 * @param callback function to run.
+		 * @param interval period after which the callback runs again; zero runs it once.
+		 * @return id for cancel().
+		 */
+		TimerId schedule(Clock::time_point when, TIMER_CALLBACK callback,
+						 std::chrono::milliseconds interval = std::chrono::milliseconds::zero());
+
+		/**
+		 * @brief Removes a pending timer. Cancelling an expired or unknown timer does nothing.
+		 * @param id id returned by schedule().
+		 * @return true when a pending timer was removed.
+		 */
+		bool cancel(TimerId id);
+
+		/**
+		 * @brief Runs all callbacks that are due, in expiry order. Callbacks may schedule and cancel timers.
+		 * @param now current time.
+		 */
+		void expire(Clock::time_point now);
+
+		/**
+		 * @brief Tells when the earliest pending timer expires.
+		 * @return expiry time, or Clock::time_point::max() when no timer is pending.
+		 */
+		Clock::time_point next_expiry() const;
+
+		/**
+		 * @brief Number of pending timers.
+		 */
+		size_t size() const { return _ticks.size(); }
+
+	private:
+		struct Timer {
+			TimerId id;
+			uint64_t tick;
+			std::chrono::milliseconds interval;
+			TIMER_CALLBACK callback;
+		};
+
+		uint64_t to_tick(Clock::time_point when) const;
+		Clock::time_point to_time(uint64_t tick) const;
+		void insert(Timer timer);
+
+		typedef std::vector<std::pair<TimerId, uint64_t>> TickTable;
+		TickTable::iterator find_tick(TimerId id);
+
+		Clock::time_point _origin;
+		// every tick up to and including this one has been expired
+		uint64_t _current_tick = 0;
+		TimerId _next_id = 1;
+		std::array<std::vector<Timer>, G13_TIMER_WHEEL_SLOTS> _slots;
+		// expiry tick of every pending timer sorted by id, to find it on cancel. Unlike a node based
+		// map it keeps its capacity, so scheduling and cancelling don't allocate once it has grown
+		TickTable _ticks;
+		// timers due in the current expire(), kept to reuse its capacity
+		std::vector<Timer> _due;
+		// earliest expiry tick, valid while _next_tick_valid is set
+		mutable uint64_t _next_tick = UINT64_MAX;
+		mutable bool _next_tick_valid = true;
+	};
+}
+
+#endif //G13_G13_TIMER_WHEEL_H
@@ -0,0 +1,173 @@
+#ifndef G13_G13_TRANSPORT_H
+#define G13_G13_TRANSPORT_H
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+
+#include <libusb-1.0/libusb.h>
+#include <linux/input.h>
+#include <sys/time.h>
+
+#include "g13_latency.h"
+
+namespace G13 {
+	/**
+	 * @brief Receives every key report in the order the endpoint delivered it.
+	 * @param report raw G13_REPORT_SIZE byte report.
+	 * @param time time the report arrived, used for all of its events.
+	 * @param received monotonic time the report arrived, for latency statistics.
+	 */
+	typedef std::function<void(unsigned char* report, const timeval& time, G13_LatencyClock::time_point received)> REPORT_CALLBACK;
+
+	/**
+	 * @brief Told once that the device is gone and no more reports will arrive. May run on the input thread.
+	 */
+	typedef std::function<void()> DEVICE_LOST_CALLBACK;
+
+	/**
+	 * @brief Source of the raw key reports of one device.
+	 */
+	class G13_KeyEndpoint {
+	public:
+		virtual ~G13_KeyEndpoint() = default;
+
+		/**
+		 * @brief Starts delivering key reports. Does nothing when already started.
+		 * @param transfer_count number of reads kept outstanding, if the endpoint queues reads.
+		 * @param callback called for each report, where the endpoint's events are handled.
+		 * @param lost called when the endpoint can no longer read the device.
+		 * @return true when reports are being delivered.
+		 */
+		virtual bool start(size_t transfer_count, REPORT_CALLBACK callback, DEVICE_LOST_CALLBACK lost) = 0;
+
+		/**
+		 * @brief Stops delivering reports and waits briefly for outstanding reads to finish.
+		 */
+		virtual void stop() = 0;
+
+		/**
+		 * @brief Writes one line of endpoint statistics.
+		 * @param out stream that receives the statistics.
+		 */
+		virtual void dump(std::ostream& out) const = 0;
+	};
+
+	/**
+	 * @brief Sink for complete LCD frames.
+	 */
+	class G13_LcdEndpoint {
+	public:
+		virtual ~G13_LcdEndpoint() = default;
+
+		/**
+		 * @brief Prepares the display for frames, once per device.
+		 */
+		virtual void init() = 0;
+
+		/**
+		 * @brief Queues a frame without blocking. A frame may be replaced by a newer one before it is shown.
+		 * @param frame G13_LCD_BUFFER_SIZE bytes of LCD data.
+		 */
+		virtual void write(const unsigned char* frame) = 0;
+
+		/**
+		 * @brief Drops pending frames and waits briefly for the one being sent.
+		 */
+		virtual void stop() = 0;
+
+		/**
+		 * @brief Writes one line of endpoint statistics.
+		 * @param out stream that receives the statistics.
+		 */
+		virtual void dump(std::ostream& out) const = 0;
+	};
+
+	/**
+	 * @brief Controls the mode LEDs and the key backlight.
+	 */
+	class G13_LedControl {
+	public:
+		virtual ~G13_LedControl() = default;
+
+		/**
+		 * @brief Sets the mode LEDs.
+		 * @param leds bitmask of mode LEDs to enable.
+		 * @return true when the LEDs were set.
+		 */
+		virtual bool set_mode_leds(int leds) = 0;
+
+		/**
+		 * @brief Sets the key backlight color.
+		 * @return true when the color was set.
+		 */
+		virtual bool set_key_color(int red, int green, int blue) = 0;
+	};
+
+	/**
+	 * @brief Destination of the Linux input events a device generates.
+	 */
+	class G13_EventSink {
+	public:
+		virtual ~G13_EventSink() = default;
+
+		/**
+		 * @brief Creates the destination, once per device.
+		 * @return true when events can be written.
+		 */
+		virtual bool open() = 0;
+
+		/**
+		 * @brief Writes a batch of events at once.
+		 * @param events events to write.
+		 * @param count number of events.
+		 */
+		virtual void write(const input_event* events, size_t count) = 0;
+
+		/**
+		 * @brief Removes the destination.
+		 */
+		virtual void close() = 0;
+	};
+
+	/**
+	 * @brief The set of transports one device talks through.
+	 *
+	 * A device owns its backend. The libusb/uinput backend drives a real G13, the memory
+	 * backend captures everything so the daemon can run without one.
+	 */
+	class G13_Backend {
+	public:
+		virtual ~G13_Backend() = default;
+
+		virtual G13_KeyEndpoint& keys() = 0;
+		virtual G13_LcdEndpoint& lcd() = 0;
+		virtual G13_LedControl& leds() = 0;
+		virtual G13_EventSink& events() = 0;
+
+		/**
+		 * @brief Gets the libusb context whose events complete this backend's transfers.
+		 * @return context to watch, or nullptr when nothing needs polling.
+		 */
+		virtual libusb_context* usb_context() const { return nullptr; }
+
+		/**
+		 * @brief Gets a short name for diagnostics.
+		 * @return backend name.
+		 */
+		virtual const char* name() const = 0;
+
+		/**
+		 * @brief Writes backend specific state, one line per transport.
+		 * @param out stream that receives the state.
+		 */
+		virtual void dump(std::ostream& out) const = 0;
+
+		/**
+		 * @brief Releases what the backend holds on the hardware. The endpoints are stopped first.
+		 */
+		virtual void close() {}
+	};
+}
+
+#endif //G13_G13_TRANSPORT_H
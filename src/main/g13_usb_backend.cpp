@@ -0,0 +1,461 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "g13_log.h"
+#include "g13_usb_backend.h"
+
+namespace G13 {
+	namespace {
+		/**
+		 * @brief Handles completion of an asynchronous libusb key transfer.
+		 * @param transfer completed libusb transfer.
+		 */
+		void transfer_cb(libusb_transfer* transfer) {
+			// Fetch the ring slot (and through it the endpoint) from user_data
+			auto* key_transfer = static_cast<G13_UsbKeyEndpoint::KeyTransfer*>(transfer->user_data);
+			key_transfer->received_at = G13_LatencyClock::now();
+			key_transfer->endpoint->complete_key_transfer(*key_transfer);
+		}
+
+		/**
+		 * @brief Handles completion of an asynchronous libusb LCD transfer.
+		 * @param transfer completed libusb transfer.
+		 */
+		void lcd_transfer_cb(libusb_transfer* transfer) {
+			static_cast<G13_UsbLcdEndpoint*>(transfer->user_data)->complete_lcd_transfer();
+		}
+
+		/**
+		 * @brief Lets libusb deliver outstanding completions until done() holds, for at most a second.
+		 * @param ctx context the transfers were submitted on.
+		 * @param done tells whether nothing is outstanding anymore.
+		 */
+		template<typename DONE>
+		void wait_for_transfers(libusb_context* ctx, DONE done) {
+			for (int attempt = 0; attempt < 10 && !done(); attempt++) {
+				timeval timeout{0, 100000};
+				libusb_handle_events_timeout_completed(ctx, &timeout, nullptr);
+			}
+		}
+	}
+
+	std::string describe_libusb_error_code(int code) {
+		switch (code) {
+			case LIBUSB_SUCCESS: return "SUCCESS";
+			case LIBUSB_ERROR_IO: return "ERROR_IO";
+			case LIBUSB_ERROR_INVALID_PARAM: return "ERROR_INVALID_PARAM";
+			case LIBUSB_ERROR_ACCESS: return "ERROR_ACCESS";
+			case LIBUSB_ERROR_NO_DEVICE: return "ERROR_NO_DEVICE";
+			case LIBUSB_ERROR_NOT_FOUND: return "ERROR_NOT_FOUND";
+			case LIBUSB_ERROR_BUSY: return "ERROR_BUSY";
+			case LIBUSB_ERROR_TIMEOUT: return "ERROR_TIMEOUT";
+			case LIBUSB_ERROR_OVERFLOW: return "ERROR_OVERFLOW";
+			case LIBUSB_ERROR_PIPE: return "ERROR_PIPE";
+			case LIBUSB_ERROR_INTERRUPTED: return "ERROR_INTERRUPTED";
+			case LIBUSB_ERROR_NO_MEM: return "ERROR_NO_MEM";
+			case LIBUSB_ERROR_NOT_SUPPORTED: return "ERROR_NOT_SUPPORTED";
+			case LIBUSB_ERROR_OTHER: return "ERROR_OTHER";
+			default: return "unknown error";
+		}
+	}
+
+	G13_UsbKeyEndpoint::~G13_UsbKeyEndpoint() {
+		for (auto& key_transfer : _key_transfers) {
+			libusb_free_transfer(key_transfer.transfer);
+		}
+	}
+
+	bool G13_UsbKeyEndpoint::start(size_t transfer_count, REPORT_CALLBACK callback, DEVICE_LOST_CALLBACK lost) {
+		// Return if transfers have already been allocated
+		if (!_key_transfers.empty())
+			return true;
+
+		_callback = std::move(callback);
+		_lost_callback = std::move(lost);
+		_key_transfers = std::vector<KeyTransfer>(std::max<size_t>(transfer_count, 1));
+		uint64_t sequence = 0;
+		for (auto& key_transfer : _key_transfers) {
+			key_transfer.endpoint = this;
+			key_transfer.transfer = libusb_alloc_transfer(0);
+			key_transfer.sequence = sequence++;
+			// pass the ring slot along as user_data, so we can find the endpoint and buffer later
+			libusb_fill_interrupt_transfer(key_transfer.transfer,
+										   _handle,
+										   LIBUSB_ENDPOINT_IN | G13_KEY_ENDPOINT,
+										   key_transfer.buffer,
+										   G13_REPORT_SIZE,
+										   transfer_cb,
+										   &key_transfer,
+										   G13_KEY_READ_TIMEOUT);
+		}
+
+		// Keep every transfer queued so a report always has somewhere to land
+		for (auto& key_transfer : _key_transfers) {
+			if (!submit_key_transfer(key_transfer)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool G13_UsbKeyEndpoint::submit_key_transfer(KeyTransfer& key_transfer) {
+		key_transfer.completed = false;
+		key_transfer.in_flight = true;
+		_key_transfers_in_flight++;
+
+		int error = libusb_submit_transfer(key_transfer.transfer);
+		if (error) {
+			key_transfer.in_flight = false;
+			key_transfer.needs_submit = true;
+			_key_transfers_in_flight--;
+			_stats.submit_errors.fetch_add(1, std::memory_order_relaxed);
+			if (error == LIBUSB_ERROR_NO_DEVICE) {
+				report_lost("device is gone");
+				return false;
+			}
+			_logger->error("Error while reading keys: " + std::to_string(error) + " ("
+						   + describe_libusb_error_code(error) + ")");
+			return false;
+		}
+		key_transfer.needs_submit = false;
+		return true;
+	}
+
+	void G13_UsbKeyEndpoint::report_lost(const std::string& reason) {
+		if (_lost) {
+			return;
+		}
+		_lost = true;
+		_logger->error("Stopped reading keys: " + reason);
+		if (_lost_callback) {
+			_lost_callback();
+		}
+	}
+
+	void G13_UsbKeyEndpoint::complete_key_transfer(KeyTransfer& key_transfer) {
+		gettimeofday(&key_transfer.completed_at, nullptr);
+		key_transfer.in_flight = false;
+		key_transfer.completed = true;
+		if (--_key_transfers_in_flight == 0 && !_stopping) {
+			// Nothing was queued on the endpoint until we resubmit
+			_stats.queue_empty.fetch_add(1, std::memory_order_relaxed);
+		}
+		if (key_transfer.sequence != _next_process_sequence) {
+			_stats.out_of_order.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		if (_stopping || _lost) {
+			return;
+		}
+		if (key_transfer.transfer->status == LIBUSB_TRANSFER_NO_DEVICE) {
+			report_lost("device is gone");
+			return;
+		}
+
+		// Retry slots whose resubmit failed on an earlier completion
+		for (auto& failed : _key_transfers) {
+			if (failed.needs_submit && !submit_key_transfer(failed) && _lost) {
+				return;
+			}
+		}
+
+		// Process reports strictly in submission order. A slot always carries a sequence
+		// number congruent to its index, so the next expected slot is found directly. A slot
+		// waiting for its resubmit holds back the ones after it until the retry went through.
+		const size_t count = _key_transfers.size();
+		for (size_t checked = 0; checked < count; checked++) {
+			KeyTransfer& next = _key_transfers[_next_process_sequence % count];
+			if (!next.completed) {
+				break;
+			}
+
+			_next_process_sequence++;
+			next.completed = false;
+			switch (next.transfer->status) {
+				case LIBUSB_TRANSFER_COMPLETED:
+					_stats.reports.fetch_add(1, std::memory_order_relaxed);
+					_callback(next.buffer, next.completed_at, next.received_at);
+					break;
+				// Ignoring these for now
+				case LIBUSB_TRANSFER_ERROR:
+				case LIBUSB_TRANSFER_TIMED_OUT:
+				case LIBUSB_TRANSFER_CANCELLED:
+				case LIBUSB_TRANSFER_STALL:
+				case LIBUSB_TRANSFER_NO_DEVICE:
+				case LIBUSB_TRANSFER_OVERFLOW:
+					break;
+			}
+
+			// Resubmit transfer for next update, one lap further along the ring
+			next.sequence += count;
+			if (!submit_key_transfer(next) && _lost) {
+				return;
+			}
+		}
+
+		// Retries only happen on completions, with none left to come the keys are dead
+		if (_key_transfers_in_flight == 0) {
+			report_lost("no key transfer could be resubmitted");
+		}
+	}
+
+	void G13_UsbKeyEndpoint::stop() {
+		_stopping = true;
+		for (auto& key_transfer : _key_transfers) {
+			if (key_transfer.in_flight) {
+				libusb_cancel_transfer(key_transfer.transfer);
+			}
+		}
+
+		// Let libusb deliver the cancellations before the transfers are freed
+		wait_for_transfers(_ctx, [this] { return _key_transfers_in_flight == 0; });
+	}
+
+	void G13_UsbKeyEndpoint::dump(std::ostream& out) const {
+		out << "   key_transfers=" << _key_transfers.size()
+			<< " reports=" << _stats.reports.load(std::memory_order_relaxed)
+			<< " queue_empty=" << _stats.queue_empty.load(std::memory_order_relaxed)
+			<< " out_of_order=" << _stats.out_of_order.load(std::memory_order_relaxed)
+			<< " submit_errors=" << _stats.submit_errors.load(std::memory_order_relaxed) << std::endl;
+	}
+
+	G13_UsbLcdEndpoint::G13_UsbLcdEndpoint(std::shared_ptr<G13_Log> logger, libusb_device_handle* handle, libusb_context* ctx) :
+			_logger(std::move(logger)), _handle(handle), _ctx(ctx) {
+		// Every LCD transfer starts with the same 32 byte header, set it up once
+		for (auto& buffer : _buffers) {
+			memset(buffer, 0, sizeof(buffer));
+			buffer[0] = 0x03;
+		}
+	}
+
+	G13_UsbLcdEndpoint::~G13_UsbLcdEndpoint() {
+		libusb_free_transfer(_transfer);
+	}
+
+	void G13_UsbLcdEndpoint::init() {
+		int error = libusb_control_transfer(_handle, 0, 9, 1, 0, 0, 0, 1000);
+		if (error) {
+			_logger->error("Error when initializing lcd endpoint");
+		}
+	}
+
+	void G13_UsbLcdEndpoint::write(const unsigned char* frame) {
+		std::lock_guard lock(_mutex);
+		// The buffer not owned by an in-flight transfer always holds the newest frame
+		const int back = 1 - _front;
+		memcpy(_buffers[back] + G13_LCD_HEADER_SIZE, frame, G13_LCD_BUFFER_SIZE);
+		if (_in_flight) {
+			if (_pending) {
+				_stats.coalesced++;
+			}
+			_pending = true;
+			return;
+		}
+
+		_front = back;
+		submit_lcd_transfer();
+	}
+
+	void G13_UsbLcdEndpoint::submit_lcd_transfer() {
+		if (_transfer == nullptr) {
+			_transfer = libusb_alloc_transfer(0);
+		}
+		libusb_fill_interrupt_transfer(_transfer, _handle, LIBUSB_ENDPOINT_OUT | G13_LCD_ENDPOINT,
+									   _buffers[_front], G13_LCD_BUFFER_SIZE + G13_LCD_HEADER_SIZE,
+									   lcd_transfer_cb, this, 1000);
+
+		int error = libusb_submit_transfer(_transfer);
+		if (error) {
+			_in_flight = false;
+			_stats.errors++;
+			_logger->error("Error when transferring image: " + std::to_string(error) + " (" + describe_libusb_error_code(error) + ")");
+			return;
+		}
+		_in_flight = true;
+		_stats.sent++;
+	}
+
+	void G13_UsbLcdEndpoint::complete_lcd_transfer() {
+		std::lock_guard lock(_mutex);
+		_in_flight = false;
+		if (_transfer->status != LIBUSB_TRANSFER_COMPLETED && _transfer->status != LIBUSB_TRANSFER_CANCELLED) {
+			_stats.errors++;
+			_logger->error("Error when transferring image: status " + std::to_string(_transfer->status) + ", "
+						   + std::to_string(_transfer->actual_length) + " bytes written");
+		}
+
+		// Send the newest frame that arrived while this one was on the wire
+		if (_pending && !_stopping) {
+			_pending = false;
+			_front = 1 - _front;
+			submit_lcd_transfer();
+		}
+	}
+
+	void G13_UsbLcdEndpoint::stop() {
+		{
+			std::lock_guard lock(_mutex);
+			_stopping = true;
+			_pending = false;
+			if (_in_flight) {
+				libusb_cancel_transfer(_transfer);
+			}
+		}
+
+		wait_for_transfers(_ctx, [this] {
+			std::lock_guard lock(_mutex);
+			return !_in_flight;
+		});
+	}
+
+	void G13_UsbLcdEndpoint::dump(std::ostream& out) const {
+		std::lock_guard lock(_mutex);
+		out << "   lcd_transfers sent=" << _stats.sent << " coalesced=" << _stats.coalesced
+			<< " errors=" << _stats.errors << std::endl;
+	}
+
+	bool G13_UsbLedControl::set_mode_leds(int leds) {
+		unsigned char usb_data[] = {5, 0, 0, 0, 0};
+		usb_data[1] = leds;
+		int r = libusb_control_transfer(_handle,
+										(uint8_t) LIBUSB_REQUEST_TYPE_CLASS | (uint8_t) LIBUSB_RECIPIENT_INTERFACE, 9, 0x305, 0,
+										usb_data, 5, 1000);
+		if (r != 5) {
+			_logger->error("Problem sending data");
+			return false;
+		}
+		return true;
+	}
+
+	bool G13_UsbLedControl::set_key_color(int red, int green, int blue) {
+		unsigned char usb_data[] = {5, 0, 0, 0, 0};
+		usb_data[1] = red;
+		usb_data[2] = green;
+		usb_data[3] = blue;
+
+		int error = libusb_control_transfer(_handle,
+											(uint8_t) LIBUSB_REQUEST_TYPE_CLASS | (uint8_t) LIBUSB_RECIPIENT_INTERFACE, 9, 0x307, 0,
+											usb_data, 5, 1000);
+		if (error != 5) {
+			_logger->error("Problem sending data");
+			return false;
+		}
+		return true;
+	}
+
+	bool G13_UinputSink::open() {
+		struct uinput_user_dev uinp;
+		const char* dev_uinput_fname =
+				access("/dev/input/uinput", F_OK) == 0 ? "/dev/input/uinput" :
+				access("/dev/uinput", F_OK) == 0 ? "/dev/uinput" : 0;
+		if (!dev_uinput_fname) {
+			_logger->error("Could not find an uinput device");
+			return false;
+		}
+		if (access(dev_uinput_fname, W_OK) != 0) {
+			_logger->error(std::string(dev_uinput_fname) + " doesn't grant write permissions");
+			return false;
+		}
+		int ufile = ::open(dev_uinput_fname, O_WRONLY | O_NDELAY);
+		if (ufile <= 0) {
+			_logger->error("Could not open uinput");
+			return false;
+		}
+		memset(&uinp, 0, sizeof(uinp));
+		char name[] = "G13";
+		strncpy(uinp.name, name, sizeof(name));
+		uinp.id.version = 1;
+		uinp.id.bustype = BUS_USB;
+		uinp.id.product = G13_PRODUCT_ID;
+		uinp.id.vendor = G13_VENDOR_ID;
+		uinp.absmin[ABS_X] = 0;
+		uinp.absmin[ABS_Y] = 0;
+		uinp.absmax[ABS_X] = 0xff;
+		uinp.absmax[ABS_Y] = 0xff;
+		//  uinp.absfuzz[ABS_X] = 4;
+		//  uinp.absfuzz[ABS_Y] = 4;
+		//  uinp.absflat[ABS_X] = 0x80;
+		//  uinp.absflat[ABS_Y] = 0x80;
+
+		ioctl(ufile, UI_SET_EVBIT, EV_KEY);
+		ioctl(ufile, UI_SET_EVBIT, EV_ABS);
+		ioctl(ufile, UI_SET_EVBIT, EV_REL);
+		ioctl(ufile, UI_SET_MSCBIT, MSC_SCAN);
+		ioctl(ufile, UI_SET_ABSBIT, ABS_X);
+		ioctl(ufile, UI_SET_ABSBIT, ABS_Y);
+		// Stick RELATIVE and SCROLL modes
+		ioctl(ufile, UI_SET_RELBIT, REL_X);
+		ioctl(ufile, UI_SET_RELBIT, REL_Y);
+		ioctl(ufile, UI_SET_RELBIT, REL_WHEEL);
+		ioctl(ufile, UI_SET_RELBIT, REL_HWHEEL);
+		for (int i = 0; i < 256; i++)
+			ioctl(ufile, UI_SET_KEYBIT, i);
+		ioctl(ufile, UI_SET_KEYBIT, BTN_THUMB);
+		// Mouse buttons, so the pointer is recognized as a mouse
+		ioctl(ufile, UI_SET_KEYBIT, BTN_LEFT);
+		ioctl(ufile, UI_SET_KEYBIT, BTN_RIGHT);
+		ioctl(ufile, UI_SET_KEYBIT, BTN_MIDDLE);
+
+		int retcode = ::write(ufile, &uinp, sizeof(uinp));
+		if (retcode < 0) {
+			_logger->error("Could not write to uinput device (" + std::to_string(retcode) + ")");
+			::close(ufile);
+			return false;
+		}
+		retcode = ioctl(ufile, UI_DEV_CREATE);
+		if (retcode) {
+			_logger->error("Error creating uinput device for G13");
+			::close(ufile);
+			return false;
+		}
+		_fd = ufile;
+		return true;
+	}
+
+	void G13_UinputSink::write(const input_event* events, size_t count) {
+		if (_fd == -1) {
+			return;
+		}
+		if (::write(_fd, events, count * sizeof(input_event)) < 0) {
+			_logger->error(std::string("Failed writing input events: ") + strerror(errno));
+		}
+	}
+
+	void G13_UinputSink::close() {
+		if (_fd == -1) {
+			return;
+		}
+		ioctl(_fd, UI_DEV_DESTROY);
+		::close(_fd);
+		_fd = -1;
+	}
+
+	G13_UsbBackend::G13_UsbBackend(std::shared_ptr<G13_Log> logger, libusb_device_handle* handle, libusb_context* ctx) :
+			_handle(handle),
+			_ctx(ctx),
+			_keys(logger, handle, ctx),
+			_lcd(logger, handle, ctx),
+			_leds(logger, handle),
+			_events(std::move(logger)) {}
+
+	void G13_UsbBackend::dump(std::ostream& out) const {
+		_keys.dump(out);
+		_lcd.dump(out);
+	}
+
+	void G13_UsbBackend::close() {
+		if (!_handle) {
+			return;
+		}
+		libusb_release_interface(_handle, 0);
+		libusb_close(_handle);
+		_handle = nullptr;
+	}
+}
@@ -0,0 +1,229 @@
+#ifndef G13_G13_USB_BACKEND_H
+#define G13_G13_USB_BACKEND_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <libusb-1.0/libusb.h>
+
+#include "g13_device.h"
+#include "g13_transport.h"
+
+namespace G13 {
+	class G13_Log;
+
+	/**
+	 * @brief Converts a libusb error code to a human-readable string.
+	 * @param code libusb status or error code.
+	 * @return human-readable libusb result text.
+	 */
+	std::string describe_libusb_error_code(int code);
+
+	/**
+	 * @brief Reads key reports through a ring of asynchronous libusb interrupt transfers.
+	 */
+	class G13_UsbKeyEndpoint : public G13_KeyEndpoint {
+	public:
+		G13_UsbKeyEndpoint(std::shared_ptr<G13_Log> logger, libusb_device_handle* handle, libusb_context* ctx) :
+				_logger(std::move(logger)), _handle(handle), _ctx(ctx) {}
+		~G13_UsbKeyEndpoint() override;
+
+		/**
+		 * @brief Allocates and submits the ring of key transfers. Reports are handled by transfer_cb.
+		 * @see https://libusb.sourceforge.io/api-1.0/group__libusb__asyncio.html#details
+		 */
+		bool start(size_t transfer_count, REPORT_CALLBACK callback, DEVICE_LOST_CALLBACK lost) override;
+		void stop() override;
+		void dump(std::ostream& out) const override;
+
+		/**
+		 * @brief One slot of the key transfer ring with its own report buffer.
+		 */
+		struct KeyTransfer {
+			G13_UsbKeyEndpoint* endpoint = nullptr;
+			libusb_transfer* transfer = nullptr;
+			unsigned char buffer[G13_REPORT_SIZE] {};
+			uint64_t sequence = 0;
+			// time the transfer completed, used for all events of its report
+			timeval completed_at {};
+			// monotonic completion time, taken first thing in transfer_cb
+			G13_LatencyClock::time_point received_at {};
+			bool in_flight = false;
+			bool completed = false;
+			// the last submit failed, the slot is retried on the next completion
+			bool needs_submit = false;
+		};
+
+		/**
+		 * @brief Handles a completed key transfer: delivers finished reports in submission order and resubmits them.
+		 * @param key_transfer ring slot whose transfer completed.
+		 */
+		void complete_key_transfer(KeyTransfer& key_transfer);
+
+	private:
+		/**
+		 * @brief Submits one slot of the key transfer ring. A failed submit keeps the slot's sequence number.
+		 * @param key_transfer ring slot to submit.
+		 * @return true when the transfer was submitted.
+		 */
+		bool submit_key_transfer(KeyTransfer& key_transfer);
+
+		/**
+		 * @brief Stops resubmitting and tells the device, once, that it is gone.
+		 * @param reason logged as why no more reports will arrive.
+		 */
+		void report_lost(const std::string& reason);
+
+		/**
+		 * @brief Counters describing the health of the key transfer ring.
+		 */
+		struct KeyTransferStats {
+			std::atomic<uint64_t> reports{0};
+			// times the last in-flight transfer completed, leaving nothing queued on the endpoint
+			std::atomic<uint64_t> queue_empty{0};
+			std::atomic<uint64_t> out_of_order{0};
+			std::atomic<uint64_t> submit_errors{0};
+		};
+
+		std::shared_ptr<G13_Log> _logger;
+		libusb_device_handle* _handle;
+		libusb_context* _ctx;
+		REPORT_CALLBACK _callback;
+		DEVICE_LOST_CALLBACK _lost_callback;
+
+		std::vector<KeyTransfer> _key_transfers;
+		uint64_t _next_process_sequence = 0;
+		size_t _key_transfers_in_flight = 0;
+		bool _stopping = false;
+		bool _lost = false;
+		KeyTransferStats _stats;
+	};
+
+	/**
+	 * @brief Sends LCD frames with asynchronous libusb transfers, double buffered.
+	 *
+	 * At most one transfer is in flight; frames written meanwhile replace each other
+	 * and only the newest one is sent once the transfer completes.
+	 */
+	class G13_UsbLcdEndpoint : public G13_LcdEndpoint {
+	public:
+		G13_UsbLcdEndpoint(std::shared_ptr<G13_Log> logger, libusb_device_handle* handle, libusb_context* ctx);
+		~G13_UsbLcdEndpoint() override;
+
+		void init() override;
+		void write(const unsigned char* frame) override;
+		void stop() override;
+		void dump(std::ostream& out) const override;
+
+		/**
+		 * @brief Handles a completed LCD transfer and sends the newest pending frame, if any.
+		 */
+		void complete_lcd_transfer();
+
+	private:
+		/**
+		 * @brief Submits the LCD transfer for the front buffer. Called with _mutex held.
+		 */
+		void submit_lcd_transfer();
+
+		/**
+		 * @brief Counters describing the LCD transfer pipeline.
+		 */
+		struct LcdTransferStats {
+			uint64_t sent = 0;
+			// frames replaced by a newer one before they could be sent
+			uint64_t coalesced = 0;
+			uint64_t errors = 0;
+		};
+
+		std::shared_ptr<G13_Log> _logger;
+		libusb_device_handle* _handle;
+		libusb_context* _ctx;
+
+		// Guards the buffers and state below, completions may arrive on the input thread
+		mutable std::mutex _mutex;
+		unsigned char _buffers[2][G13_LCD_BUFFER_SIZE + G13_LCD_HEADER_SIZE];
+		int _front = 0;
+		bool _in_flight = false;
+		bool _pending = false;
+		bool _stopping = false;
+		libusb_transfer* _transfer = nullptr;
+		LcdTransferStats _stats;
+	};
+
+	/**
+	 * @brief Sets the LEDs with libusb control transfers.
+	 */
+	class G13_UsbLedControl : public G13_LedControl {
+	public:
+		G13_UsbLedControl(std::shared_ptr<G13_Log> logger, libusb_device_handle* handle) :
+				_logger(std::move(logger)), _handle(handle) {}
+
+		bool set_mode_leds(int leds) override;
+		bool set_key_color(int red, int green, int blue) override;
+
+	private:
+		std::shared_ptr<G13_Log> _logger;
+		libusb_device_handle* _handle;
+	};
+
+	/**
+	 * @brief Writes input events to a uinput device.
+	 */
+	class G13_UinputSink : public G13_EventSink {
+	public:
+		explicit G13_UinputSink(std::shared_ptr<G13_Log> logger) : _logger(std::move(logger)) {}
+		~G13_UinputSink() override { close(); }
+
+		/**
+		 * @brief Creates and configures the uinput device.
+		 */
+		bool open() override;
+		void write(const input_event* events, size_t count) override;
+		void close() override;
+
+	private:
+		std::shared_ptr<G13_Log> _logger;
+		int _fd = -1;
+	};
+
+	/**
+	 * @brief Backend for a real G13: libusb for the device, uinput for the events.
+	 */
+	class G13_UsbBackend : public G13_Backend {
+	public:
+		/**
+		 * @brief Takes over an open handle whose interface was claimed.
+		 * @param logger logger used for transport diagnostics.
+		 * @param handle open libusb device handle, closed by close().
+		 * @param ctx libusb context the handle was opened with.
+		 */
+		G13_UsbBackend(std::shared_ptr<G13_Log> logger, libusb_device_handle* handle, libusb_context* ctx);
+
+		G13_KeyEndpoint& keys() override { return _keys; }
+		G13_LcdEndpoint& lcd() override { return _lcd; }
+		G13_LedControl& leds() override { return _leds; }
+		G13_EventSink& events() override { return _events; }
+		libusb_context* usb_context() const override { return _ctx; }
+		const char* name() const override { return "usb"; }
+		void dump(std::ostream& out) const override;
+
+		/**
+		 * @brief Releases the interface and closes the handle.
+		 */
+		void close() override;
+
+	private:
+		libusb_device_handle* _handle;
+		libusb_context* _ctx;
+		G13_UsbKeyEndpoint _keys;
+		G13_UsbLcdEndpoint _lcd;
+		G13_UsbLedControl _leds;
+		G13_UinputSink _events;
+	};
+}
+
+#endif //G13_G13_USB_BACKEND_H
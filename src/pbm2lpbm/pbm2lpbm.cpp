@@ -3,8 +3,10 @@
 #include <cstdio>
 using namespace std;
 // convert a .pbm raw file to our custom .lpbm format
+// with --framed the output is an LCD frame for the g13d input pipe
 
 int main(int argc, char *argv[]) {
+  bool framed = argc > 1 && !strcmp(argv[1], "--framed");
   unsigned char c;
   const int LEN = 256;
   char s[LEN];
@@ -47,6 +49,11 @@ int main(int argc, char *argv[]) {
   if(i != 160*43/8) {
     cerr << "wrong number of bytes, expected " << 160*43/8 << ", got " << i << endl;
   }
+  if(framed) {
+    // magic "\0G13", type 2 (LCD), reserved, payload length 960 little endian
+    const unsigned char header[8] = {0, 'G', '1', '3', 2, 0, (160*48/8) & 0xff, (160*48/8) >> 8};
+    cout.write((const char *)header, sizeof(header));
+  }
   for(int i = 0; i < 160*48/8;i++) {
     cout << hex << (char)buf[i];
   }
@@ -0,0 +1,128 @@
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <new>
+
+#include "container.h"
+#include "g13_device.h"
+#include "g13_event_loop.h"
+#include "g13_framework.h"
+#include "g13_log.h"
+#include "g13_memory_backend.h"
+
+using namespace G13;
+
+namespace {
+	// Allocations made through operator new while counting is on
+	size_t allocations = 0;
+	bool counting = false;
+
+	void* allocate(std::size_t size, std::size_t alignment) {
+		if (counting) {
+			allocations++;
+		}
+		size = size ? size : 1;
+		void* memory = alignment > alignof(std::max_align_t)
+			? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+			: std::malloc(size);
+		if (memory == nullptr) {
+			throw std::bad_alloc();
+		}
+		return memory;
+	}
+
+	/**
+	 * @brief Builds a report with the stick at x/y and the keys of the mask (bit N is key N) held.
+	 */
+	void make_report(unsigned char* report, unsigned char x, unsigned char y, uint64_t keys) {
+		report[0] = 1;
+		report[1] = x;
+		report[2] = y;
+		for (size_t i = 3; i < G13_REPORT_SIZE; i++) {
+			report[i] = keys >> (i - 3) * 8 & 0xff;
+		}
+	}
+}
+
+void* operator new(std::size_t size) { return allocate(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate(size, size_t(alignment)); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+
+/**
+ * Drives key and stick reports through a device on the memory backend with the log level at
+ * info, and fails if handling them allocates once every path has run a first time.
+ */
+int main() {
+	bootFramework();
+	auto logger = Container::Instance().Resolve<G13_Log>();
+	logger->set_log_level("info");
+
+	const auto profiles_dir = std::filesystem::temp_directory_path() / "g13_alloc_test";
+	auto backend = std::make_unique<G13_MemoryBackend>(0, 0);
+	G13_MemoryKeyEndpoint& keys = backend->memory_keys();
+	G13_Device device(logger, std::move(backend), 0, profiles_dir.string());
+	device.init();
+
+	G13_EventLoop loop(logger);
+	if (!device.attach_timers(loop) || device.read_keys(1) < 0) {
+		std::fprintf(stderr, "could not start the device\n");
+		return 1;
+	}
+
+	// Plain keys, a chord, a hold and the stick zones with a filter
+	device.command("bind G1 KEY_A");
+	device.command("bind G2 KEY_B");
+	device.command("bindchord G3+G4 KEY_ESC");
+	device.command("bindhold G5 250 KEY_LEFTCTRL");
+	device.command("stickmode KEYS");
+	device.command("stickfilter ema 0.5");
+
+	struct Step {
+		unsigned char x;
+		unsigned char y;
+		uint64_t keys;
+	};
+	const Step steps[] = {
+		{127, 127, 0},
+		{127, 127, 1 << 0},
+		{127, 40, 1 << 0 | 1 << 1},
+		{20, 127, 1 << 1},
+		{20, 127, 1 << 2 | 1 << 3},
+		{230, 127, 1 << 3},
+		{127, 230, 1 << 4},
+		{127, 10, 0},
+		{127, 127, 0},
+	};
+
+	unsigned char report[G13_REPORT_SIZE];
+	auto run = [&] {
+		for (const Step& step : steps) {
+			make_report(report, step.x, step.y, step.keys);
+			keys.inject(report);
+		}
+	};
+
+	// The first round may size buffers, timer slots and the like
+	for (int i = 0; i < 4; i++) {
+		run();
+	}
+
+	counting = true;
+	for (int i = 0; i < 1000; i++) {
+		run();
+	}
+	counting = false;
+
+	device.cleanup();
+
+	if (allocations != 0) {
+		std::fprintf(stderr, "handling reports allocated %zu times\n", allocations);
+		return 1;
+	}
+	std::printf("handled %zu reports without allocating\n", std::size(steps) * 1000);
+	return 0;
+}